@@ -3,6 +3,7 @@
 #include <iostream>
 #include "glad/glad.h"
 
+#include "graphics/vertex_array_cache.h"
 #include "log.h"
 
 static void APIENTRY DebugCallback(
@@ -107,7 +108,10 @@ namespace gt {
 	}
 
 	void GameWindow::cleanup() {
-		if (m_context) SDL_GL_DeleteContext(m_context);
+		if (m_context) {
+			VertexArrayCache::get().clear();
+			SDL_GL_DeleteContext(m_context);
+		}
 		if (m_window) SDL_DestroyWindow(m_window);
 		SDL_Quit();
 	}
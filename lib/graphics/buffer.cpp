@@ -1,10 +1,16 @@
 #include "buffer.h"
+#include "gl_state.h"
+#include "vertex_array_cache.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 namespace gt {
 	void Buffer::destroy() {
 		if (m_id) {
+			GLState::get().forgetBuffer(m_id);
+			VertexArrayCache::get().forgetBuffer(m_id);
 			glDeleteBuffers(1, &m_id);
 			m_id = 0;
 		}
@@ -17,17 +23,155 @@ namespace gt {
 	}
 
 	Buffer& Buffer::bind() {
-		glBindBuffer(GLenum(m_type), m_id);
+		GLState::get().buffer(GLenum(m_type), m_id);
 		return *this;
 	}
 
 	Buffer& Buffer::unbind() {
-		glBindBuffer(GLenum(m_type), 0);
+		GLState::get().buffer(GLenum(m_type), 0);
 		return *this;
 	}
 
 	Buffer& Buffer::bindBase(u32 bindingPoint) {
-		glBindBufferBase(GLenum(m_type), bindingPoint, m_id);
+		GLState::get().bufferBase(GLenum(m_type), bindingPoint, m_id);
+		return *this;
+	}
+
+	Buffer& Buffer::bindRange(u32 bindingPoint, u32 offset, u32 size) {
+		GLState::get().bufferRange(GLenum(m_type), bindingPoint, m_id, offset, size);
+		return *this;
+	}
+
+	// Unsynchronized mapped write, glBufferSubData when the map fails.
+	static void writeUnsynchronized(GLenum target, u32 offset, size_t size, const void* data) {
+		const u32 flags = Buffer::MapWrite | Buffer::MapInvalidateRange | Buffer::MapUnsynchronized;
+		void* dst = glMapBufferRange(target, offset, size, flags);
+		if (!dst) {
+			glBufferSubData(target, offset, size, data);
+			return;
+		}
+		std::memcpy(dst, data, size);
+		glUnmapBuffer(target);
+	}
+
+	Buffer& Buffer::write(const void* data, size_t size, BufferUsage usage, i32 offset) {
+		const GLenum target = GLenum(m_type);
+		if (m_policy == PolicyRing) {
+			u32 at = (m_head + m_alignment - 1) / m_alignment * m_alignment;
+			if (size > m_size) {
+				reserve(size, usage);
+				at = 0;
+			} else if (at + size > m_size) {
+				reserve(m_size, m_usage);
+				at = 0;
+			}
+			// nothing in flight uses the space past the head
+			writeUnsynchronized(target, at, size, data);
+			m_streamOffset = at;
+			m_head = at + size;
+			return *this;
+		}
+
+		m_streamOffset = offset;
+		if (offset + size > m_size) {
+			// growing drops the old contents
+			if (offset == 0) {
+				glBufferData(target, size, data, GLenum(usage));
+				m_size = size;
+				m_usage = usage;
+			} else {
+				reserve(offset + size, usage);
+				m_streamOffset = offset;
+				glBufferSubData(target, offset, size, data);
+			}
+			return *this;
+		}
+
+		switch (m_policy) {
+			case PolicyOrphan:
+				glBufferData(target, m_size, nullptr, GLenum(m_usage));
+				glBufferSubData(target, offset, size, data);
+				break;
+			case PolicyUnsynchronized:
+				writeUnsynchronized(target, offset, size, data);
+				break;
+			default:
+				glBufferSubData(target, offset, size, data);
+				break;
+		}
+		return *this;
+	}
+
+	Buffer& Buffer::reserve(size_t size, BufferUsage usage) {
+		glBufferData(GLenum(m_type), size, nullptr, GLenum(usage));
+		m_size = size;
+		m_usage = usage;
+		m_head = m_streamOffset = 0;
+		return *this;
+	}
+
+	Buffer& Buffer::streamPolicy(StreamPolicy policy, u32 alignment) {
+		m_policy = policy;
+		m_alignment = std::max(alignment, 1u);
+		m_head = m_streamOffset = 0;
+		return *this;
+	}
+
+	Buffer& Buffer::markDirty(u32 offset, u32 size) {
+		const u32 end = offset + size;
+		if (!m_dirty.empty()) {
+			// sequential writes grow the last range
+			Range& last = m_dirty.back();
+			if (offset >= last.begin && offset <= last.end) {
+				last.end = std::max(last.end, end);
+				return *this;
+			}
+		}
+		m_dirty.push_back({ offset, end });
+		return *this;
+	}
+
+	u32 Buffer::uploadDirty(const void* source, u32 gap, BufferUsage usage) {
+		if (m_dirty.empty()) return 0;
+
+		std::sort(m_dirty.begin(), m_dirty.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+		const u8* src = static_cast<const u8*>(source);
+		u32 end = 0;
+		for (const Range& r : m_dirty) end = std::max(end, r.end);
+		if (end > m_size) {
+			// growing drops the old contents, send the whole mirror
+			glBufferData(GLenum(m_type), end, src, GLenum(usage));
+			m_size = end;
+			m_usage = usage;
+			m_dirty.clear();
+			return end;
+		}
+
+		// ranges go to their own offsets, whatever the stream policy
+		const GLenum target = GLenum(m_type);
+		u32 bytes = 0;
+		Range range = m_dirty[0];
+		for (size_t i = 1; i <= m_dirty.size(); i++) {
+			if (i < m_dirty.size() && m_dirty[i].begin <= range.end + gap) {
+				range.end = std::max(range.end, m_dirty[i].end);
+				continue;
+			}
+			if (m_policy == PolicyUnsynchronized) {
+				writeUnsynchronized(target, range.begin, range.end - range.begin, src + range.begin);
+			} else {
+				glBufferSubData(target, range.begin, range.end - range.begin, src + range.begin);
+			}
+			bytes += range.end - range.begin;
+			if (i < m_dirty.size()) range = m_dirty[i];
+		}
+		m_dirty.clear();
+		return bytes;
+	}
+
+	Buffer& Buffer::storage(u32 size, u32 flags, const void* data) {
+		glBufferStorage(GLenum(m_type), size, data, flags);
+		m_size = size;
 		return *this;
 	}
 
@@ -41,16 +185,20 @@ namespace gt {
 	}
 
 	void VertexArray::destroy() {
-		if (m_id) glDeleteVertexArrays(1, &m_id);
+		if (m_id) {
+			GLState::get().forgetVertexArray(m_id);
+			glDeleteVertexArrays(1, &m_id);
+			m_id = 0;
+		}
 	}
 
 	VertexArray& VertexArray::bind() {
-		glBindVertexArray(m_id);
+		GLState::get().vertexArray(m_id);
 		return *this;
 	}
 
 	VertexArray& VertexArray::unbind() {
-		glBindVertexArray(0);
+		GLState::get().vertexArray(0);
 		return *this;
 	}
 
@@ -15,7 +15,8 @@ namespace gt {
 			ArrayBuffer = GL_ARRAY_BUFFER,
 			ElementBuffer = GL_ELEMENT_ARRAY_BUFFER,
 			UniformBuffer = GL_UNIFORM_BUFFER,
-			ShaderStorageBuffer = GL_SHADER_STORAGE_BUFFER
+			ShaderStorageBuffer = GL_SHADER_STORAGE_BUFFER,
+			DrawIndirectBuffer = GL_DRAW_INDIRECT_BUFFER
 		};
 
 		enum BufferUsage {
@@ -36,6 +37,34 @@ namespace gt {
 			AccessReadWrite = GL_READ_WRITE
 		};
 
+		enum MapFlags {
+			StorageDynamic = GL_DYNAMIC_STORAGE_BIT,
+			StorageClient = GL_CLIENT_STORAGE_BIT,
+			MapRead = GL_MAP_READ_BIT,
+			MapWrite = GL_MAP_WRITE_BIT,
+			MapPersistent = GL_MAP_PERSISTENT_BIT,
+			MapCoherent = GL_MAP_COHERENT_BIT,
+			MapInvalidateRange = GL_MAP_INVALIDATE_RANGE_BIT,
+			MapInvalidateBuffer = GL_MAP_INVALIDATE_BUFFER_BIT,
+			MapFlushExplicit = GL_MAP_FLUSH_EXPLICIT_BIT,
+			MapUnsynchronized = GL_MAP_UNSYNCHRONIZED_BIT
+		};
+
+		// How update() writes into a buffer that already has room.
+		// PolicyInPlace uses glBufferSubData, which waits for draws still
+		// reading the buffer. PolicyOrphan detaches the old storage first, so
+		// everything outside the written range is lost. PolicyUnsynchronized
+		// maps the range without waiting, the caller makes sure the GPU is done
+		// with it. PolicyRing ignores the offset and appends after the previous
+		// write, starting over on fresh storage when full; streamOffset() tells
+		// where the data went.
+		enum StreamPolicy {
+			PolicyInPlace = 0,
+			PolicyOrphan,
+			PolicyUnsynchronized,
+			PolicyRing
+		};
+
 		Buffer() = default;
 		~Buffer() = default;
 
@@ -46,25 +75,55 @@ namespace gt {
 		Buffer& unbind();
 
 		Buffer& bindBase(u32 bindingPoint);
+		Buffer& bindRange(u32 bindingPoint, u32 offset, u32 size);
 
 		template <typename DataType>
 		inline Buffer& update(const std::vector<DataType>& data, BufferUsage usage = StaticDraw, i32 offset = 0) {
-			const size_t size = sizeof(DataType) * data.size();
-			if (size > m_size) {
-				glBufferData(GLenum(m_type), size, data.data(), GLenum(usage));
-				m_size = size;
-				m_usage = usage;
-			} else {
-				glBufferSubData(GLenum(m_type), offset, size, data.data());
-			}
-			return *this;
+			return update(data.data(), data.size(), usage, offset);
 		}
 
+		template <typename DataType>
+		inline Buffer& update(const DataType* data, size_t count, BufferUsage usage = StaticDraw, i32 offset = 0) {
+			return write(data, sizeof(DataType) * count, usage, offset);
+		}
+
+		template <typename DataType, size_t Count>
+		inline Buffer& update(const DataType (&data)[Count], BufferUsage usage = StaticDraw, i32 offset = 0) {
+			return write(data, sizeof(DataType) * Count, usage, offset);
+		}
+
+		Buffer& write(const void* data, size_t size, BufferUsage usage = StaticDraw, i32 offset = 0);
+
+		// Allocates undefined storage and restarts the ring.
+		Buffer& reserve(size_t size, BufferUsage usage);
+
+		// Ring writes start at multiples of `alignment`.
+		Buffer& streamPolicy(StreamPolicy policy, u32 alignment = 1);
+		StreamPolicy streamPolicy() const { return m_policy; }
+		u32 streamOffset() const { return m_streamOffset; }
+
+		// Byte ranges changed since the last uploadDirty(). The ranges are
+		// sorted and merged when uploaded, `gap` also merges ranges that
+		// are less than that many bytes apart. `source` is the CPU copy the
+		// buffer mirrors, read at the same offsets. Ranges are written in
+		// place under every stream policy. Returns the bytes sent.
+		Buffer& markDirty(u32 offset, u32 size);
+		u32 uploadDirty(const void* source, u32 gap = 0, BufferUsage usage = StaticDraw);
+		void clearDirty() { m_dirty.clear(); }
+		bool dirty() const { return !m_dirty.empty(); }
+
+		Buffer& storage(u32 size, u32 flags, const void* data = nullptr);
+
 		template <typename DataType>
 		inline DataType* map(BufferAccess access = AccessReadWrite) {
 			return (DataType*) glMapBuffer(GLenum(m_type), GLenum(access));
 		}
 
+		template <typename DataType>
+		inline DataType* mapRange(u32 offset, u32 length, u32 flags) {
+			return (DataType*) glMapBufferRange(GLenum(m_type), offset, length, flags);
+		}
+
 		void unmap();
 
 		GLuint id() const { return m_id; }
@@ -72,11 +131,22 @@ namespace gt {
 		BufferUsage usage() const { return m_usage; }
 		u32 size() const { return m_size; }
 
+		static bool storageSupported() { return GLAD_GL_ARB_buffer_storage && glad_glBufferStorage; }
+
 	private:
+		struct Range {
+			u32 begin, end;
+		};
+
 		GLuint m_id{ 0 };
 		BufferType m_type;
 		BufferUsage m_usage;
 		u32 m_size{ 0 };
+
+		StreamPolicy m_policy{ PolicyInPlace };
+		u32 m_alignment{ 1 }, m_head{ 0 }, m_streamOffset{ 0 };
+
+		std::vector<Range> m_dirty;
 	};
 
 	enum DataType {
@@ -91,63 +161,131 @@ namespace gt {
 		TypeFixed = GL_FIXED
 	};
 
+	inline constexpr u32 dataTypeSize(DataType type) {
+		switch (type) {
+			case DataType::TypeUByte:
+			case DataType::TypeByte: return 1;
+			case DataType::TypeUShort:
+			case DataType::TypeShort: return 2;
+			case DataType::TypeUInt:
+			case DataType::TypeInt: return 4;
+			case DataType::TypeFloat: return 4;
+			case DataType::TypeHalfFloat: return 2;
+			case DataType::TypeFixed: return 4;
+			default: return 1;
+		}
+	}
+
+	// How the shader reads an attribute. Float and normalized attributes are
+	// converted to float, integer ones reach int/uint inputs unchanged.
+	// AttributeHalf only exists for vertexAttribute(): the u16 member holds
+	// half floats, and the attribute is stored as a float TypeHalfFloat.
+	enum AttributeMode {
+		AttributeFloat = 0,
+		AttributeNormalized,
+		AttributeInteger,
+		AttributeHalf
+	};
+
+	struct VertexAttribute {
+		DataType type;
+		u8 size;
+		AttributeMode mode;
+		u32 offset;
+
+		constexpr u32 bytes() const { return dataTypeSize(type) * size; }
+
+		constexpr bool operator==(const VertexAttribute& o) const {
+			return type == o.type && size == o.size && mode == o.mode && offset == o.offset;
+		}
+		constexpr bool operator!=(const VertexAttribute& o) const { return !(*this == o); }
+	};
+
 	class VertexFormat {
 	public:
-		struct Field {
-			DataType type;
-			u8 size;
-			bool normalized;
-		};
-
+		using Field = VertexAttribute;
 		using FieldList = std::vector<Field>;
 
 		VertexFormat() = default;
-		VertexFormat(size_t stride) : m_stride(stride) {}
+		VertexFormat(size_t stride, u32 divisor = 0) : m_stride(stride), m_divisor(divisor) {}
+		VertexFormat(size_t stride, const VertexAttribute* attributes, u32 count, u32 divisor = 0)
+			: m_stride(stride), m_divisor(divisor), m_fields(attributes, attributes + count) {}
 		~VertexFormat() = default;
 
+		// Packs fields one after another, in location order.
 		inline VertexFormat& add(u8 size, DataType type, bool normalized = false) {
 			Field field;
 			field.type = type;
 			field.size = size;
-			field.normalized = normalized;
+			field.mode = normalized ? AttributeNormalized : AttributeFloat;
+			field.offset = m_fields.empty() ? 0 : m_fields.back().offset + m_fields.back().bytes();
 			m_fields.push_back(field);
 			return *this;
 		}
 
 		inline void enable() {
-			u32 off = 0, i = 0;
-			for (auto&& field : m_fields) {
+			for (u32 i = 0; i < m_fields.size(); i++) {
+				const Field& field = m_fields[i];
+				const void* offset = reinterpret_cast<void*>(uintptr_t(field.offset));
+				glEnableVertexAttribArray(i);
+				if (field.mode == AttributeInteger) {
+					glVertexAttribIPointer(i, field.size, field.type, m_stride, offset);
+				} else {
+					glVertexAttribPointer(i, field.size, field.type, field.mode == AttributeNormalized, m_stride, offset);
+				}
+				if (m_divisor) glVertexAttribDivisor(i, m_divisor);
+			}
+		}
+
+		// Attribute formats only, reading from vertex buffer binding `binding`.
+		// The buffer itself is attached with glBindVertexBuffer, see
+		// VertexArrayCache.
+		inline void enableFormat(u32 binding = 0) const {
+			for (u32 i = 0; i < m_fields.size(); i++) {
+				const Field& field = m_fields[i];
 				glEnableVertexAttribArray(i);
-				glVertexAttribPointer(i, field.size, field.type, field.normalized, m_stride, reinterpret_cast<void*>(off));
-				i++;
-				off += getDataTypeSize(field.type) * field.size;
+				if (field.mode == AttributeInteger) {
+					glVertexAttribIFormat(i, field.size, field.type, field.offset);
+				} else {
+					glVertexAttribFormat(i, field.size, field.type, field.mode == AttributeNormalized, field.offset);
+				}
+				glVertexAttribBinding(i, binding);
+			}
+			glVertexBindingDivisor(binding, m_divisor);
+		}
+
+		// Same for formats that would set up a vertex array the same way.
+		inline u64 hash() const {
+			u64 h = 14695981039346656037ull;
+			const auto mix = [&h](u64 v) { h = (h ^ v) * 1099511628211ull; };
+			mix(m_stride);
+			mix(m_divisor);
+			for (const Field& field : m_fields) {
+				mix(u64(field.type) << 32 | u64(field.size) << 8 | u64(field.mode));
+				mix(field.offset);
 			}
+			return h;
 		}
 
+		bool operator==(const VertexFormat& o) const {
+			return m_stride == o.m_stride && m_divisor == o.m_divisor && m_fields == o.m_fields;
+		}
+		bool operator!=(const VertexFormat& o) const { return !(*this == o); }
+
 		inline void disable() {
 			for (u32 i = 0; i < m_fields.size(); i++) {
 				glDisableVertexAttribArray(i);
 			}
 		}
 
+		const FieldList& fields() const { return m_fields; }
+		size_t stride() const { return m_stride; }
+		u32 divisor() const { return m_divisor; }
+
 	private:
 		size_t m_stride;
+		u32 m_divisor{ 0 };
 		FieldList m_fields;
-
-		inline size_t getDataTypeSize(DataType type) {
-			switch (type) {
-				case DataType::TypeUByte:
-				case DataType::TypeByte: return 1;
-				case DataType::TypeUShort:
-				case DataType::TypeShort: return 2;
-				case DataType::TypeUInt:
-				case DataType::TypeInt: return 4;
-				case DataType::TypeFloat: return 4;
-				case DataType::TypeHalfFloat: return 2;
-				case DataType::TypeFixed: return 4;
-				default: return 1;
-			}
-		}
 	};
 
 	class VertexArray {
@@ -160,8 +298,10 @@ namespace gt {
 		VertexArray& bind();
 		VertexArray& unbind();
 
+		GLuint id() const { return m_id; }
+
 	private:
-		GLuint m_id;
+		GLuint m_id{ 0 };
 	};
 }
 
@@ -0,0 +1,264 @@
+#include "buffer_heap.h"
+
+#include <algorithm>
+#include <numeric>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+namespace gt {
+
+	static u32 highBit(u32 v) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanReverse(&i, v);
+		return i;
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+
+	static u32 lowBit(u32 v) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, v);
+		return i;
+#else
+		return __builtin_ctz(v);
+#endif
+	}
+
+	void OffsetAllocator::reset(u32 size) {
+		m_blocks.clear();
+		m_unusedBlocks.clear();
+		for (auto& heads : m_heads) std::fill(std::begin(heads), std::end(heads), Invalid);
+		std::fill(std::begin(m_secondMap), std::end(m_secondMap), 0u);
+		m_firstMap = 0;
+		m_size = m_free = size;
+		m_allocations = m_freeBlocks = 0;
+		if (size == 0) return;
+
+		const u32 block = newBlock();
+		m_blocks[block] = { 0, size, Invalid, Invalid, Invalid, Invalid, false };
+		insert(block);
+	}
+
+	// Size class of `size`: the power of two, then one of 16 steps inside it.
+	// Sizes under 16 get a class each.
+	static void sizeClass(u32 size, u32 secondBits, u32& first, u32& second) {
+		const u32 secondCount = 1 << secondBits;
+		if (size < secondCount) {
+			first = 0;
+			second = size;
+		} else {
+			const u32 top = highBit(size);
+			first = top - secondBits + 1;
+			second = (size >> (top - secondBits)) - secondCount;
+		}
+	}
+
+	OffsetAllocator::Allocation OffsetAllocator::allocate(u32 size) {
+		if (size == 0 || size > m_free) return {};
+
+		const u32 block = findFree(size);
+		if (block == Invalid) return {};
+		remove(block);
+
+		if (m_blocks[block].size > size) {
+			const u32 rest = newBlock();
+			const Block& b = m_blocks[block];
+			m_blocks[rest] = { b.offset + size, b.size - size, block, b.next, Invalid, Invalid, false };
+			if (b.next != Invalid) m_blocks[b.next].prev = rest;
+			m_blocks[block].next = rest;
+			m_blocks[block].size = size;
+			insert(rest);
+		}
+
+		m_blocks[block].used = true;
+		m_free -= size;
+		m_allocations++;
+		return { m_blocks[block].offset, size, block };
+	}
+
+	void OffsetAllocator::free(const Allocation& allocation) {
+		if (!allocation.valid()) return;
+
+		u32 block = allocation.node;
+		m_blocks[block].used = false;
+		m_free += m_blocks[block].size;
+		m_allocations--;
+
+		const u32 prev = m_blocks[block].prev;
+		if (prev != Invalid && !m_blocks[prev].used) {
+			remove(prev);
+			m_blocks[prev].size += m_blocks[block].size;
+			m_blocks[prev].next = m_blocks[block].next;
+			if (m_blocks[block].next != Invalid) m_blocks[m_blocks[block].next].prev = prev;
+			m_unusedBlocks.push_back(block);
+			block = prev;
+		}
+
+		const u32 next = m_blocks[block].next;
+		if (next != Invalid && !m_blocks[next].used) {
+			remove(next);
+			m_blocks[block].size += m_blocks[next].size;
+			m_blocks[block].next = m_blocks[next].next;
+			if (m_blocks[next].next != Invalid) m_blocks[m_blocks[next].next].prev = block;
+			m_unusedBlocks.push_back(next);
+		}
+
+		insert(block);
+	}
+
+	u32 OffsetAllocator::largestFree() const {
+		if (!m_firstMap) return 0;
+		const u32 first = highBit(m_firstMap);
+		const u32 second = highBit(m_secondMap[first]);
+
+		// the top class is a size range, look through it
+		u32 largest = 0;
+		for (u32 b = m_heads[first][second]; b != Invalid; b = m_blocks[b].nextFree) {
+			largest = std::max(largest, m_blocks[b].size);
+		}
+		return largest;
+	}
+
+	u32 OffsetAllocator::newBlock() {
+		if (!m_unusedBlocks.empty()) {
+			const u32 block = m_unusedBlocks.back();
+			m_unusedBlocks.pop_back();
+			return block;
+		}
+		m_blocks.emplace_back();
+		return m_blocks.size() - 1;
+	}
+
+	void OffsetAllocator::insert(u32 block) {
+		u32 first, second;
+		sizeClass(m_blocks[block].size, SecondBits, first, second);
+
+		const u32 head = m_heads[first][second];
+		m_blocks[block].prevFree = Invalid;
+		m_blocks[block].nextFree = head;
+		if (head != Invalid) m_blocks[head].prevFree = block;
+		m_heads[first][second] = block;
+
+		m_secondMap[first] |= 1u << second;
+		m_firstMap |= 1u << first;
+		m_freeBlocks++;
+	}
+
+	void OffsetAllocator::remove(u32 block) {
+		u32 first, second;
+		sizeClass(m_blocks[block].size, SecondBits, first, second);
+
+		const Block& b = m_blocks[block];
+		if (b.prevFree != Invalid) m_blocks[b.prevFree].nextFree = b.nextFree;
+		if (b.nextFree != Invalid) m_blocks[b.nextFree].prevFree = b.prevFree;
+		if (m_heads[first][second] == block) {
+			m_heads[first][second] = b.nextFree;
+			if (b.nextFree == Invalid) {
+				m_secondMap[first] &= ~(1u << second);
+				if (!m_secondMap[first]) m_firstMap &= ~(1u << first);
+			}
+		}
+		m_freeBlocks--;
+	}
+
+	u32 OffsetAllocator::findFree(u32 size) const {
+		// round up to the next class, every block in it is large enough
+		if (size >= SecondCount) size += (1u << (highBit(size) - SecondBits)) - 1;
+
+		u32 first, second;
+		sizeClass(size, SecondBits, first, second);
+
+		u32 secondMap = m_secondMap[first] & (~0u << second);
+		if (!secondMap) {
+			const u32 firstMap = m_firstMap & (~0u << (first + 1));
+			if (!firstMap) return Invalid;
+			first = lowBit(firstMap);
+			secondMap = m_secondMap[first];
+		}
+		return m_heads[first][lowBit(secondMap)];
+	}
+
+	BufferHeap::~BufferHeap() {
+		destroy();
+	}
+
+	BufferHeap& BufferHeap::create(Buffer::BufferType type, u32 pageSize, u32 alignment, Buffer::BufferUsage usage) {
+		destroy();
+		m_type = type;
+		m_usage = usage;
+
+		// bindRange() offsets must be multiples of the GL alignment
+		GLint required = 1;
+		if (type == Buffer::UniformBuffer) glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &required);
+		else if (type == Buffer::ShaderStorageBuffer) glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &required);
+		m_alignment = std::lcm(std::max(alignment, 1u), u32(std::max(required, 1)));
+
+		m_pageUnits = (pageSize + m_alignment - 1) / m_alignment;
+		addPage(m_pageUnits);
+		return *this;
+	}
+
+	void BufferHeap::destroy() {
+		for (Page& page : m_pages) page.buffer.destroy();
+		m_pages.clear();
+	}
+
+	BufferHeap::Allocation BufferHeap::allocate(u32 size) {
+		const u32 units = std::max((size + m_alignment - 1) / m_alignment, 1u);
+		for (u32 i = 0; i < m_pages.size(); i++) {
+			const OffsetAllocator::Allocation range = m_pages[i].allocator.allocate(units);
+			if (range.valid()) return { i, range.offset * m_alignment, size, range };
+		}
+
+		Page& page = addPage(std::max(m_pageUnits, units));
+		const OffsetAllocator::Allocation range = page.allocator.allocate(units);
+		return { u32(m_pages.size() - 1), range.offset * m_alignment, size, range };
+	}
+
+	void BufferHeap::free(Allocation& allocation) {
+		if (!allocation.valid()) return;
+		m_pages[allocation.page].allocator.free(allocation.range);
+		allocation = Allocation();
+	}
+
+	BufferHeap& BufferHeap::update(const Allocation& allocation, const void* data, u32 size, u32 offset) {
+		m_pages[allocation.page].buffer.bind().write(data, size, m_usage, allocation.offset + offset);
+		return *this;
+	}
+
+	BufferHeap& BufferHeap::bindRange(const Allocation& allocation, u32 bindingPoint) {
+		m_pages[allocation.page].buffer.bindRange(bindingPoint, allocation.offset, allocation.size);
+		return *this;
+	}
+
+	BufferHeap::Stats BufferHeap::stats() const {
+		Stats stats{ u32(m_pages.size()), 0, 0, 0, 0, 0, 0.0f };
+		u32 free = 0;
+		for (const Page& page : m_pages) {
+			const OffsetAllocator& a = page.allocator;
+			stats.capacity += a.size() * m_alignment;
+			free += a.freeSize() * m_alignment;
+			stats.allocations += a.allocationCount();
+			stats.freeBlocks += a.freeBlockCount();
+			stats.largestFree = std::max(stats.largestFree, a.largestFree() * m_alignment);
+		}
+		stats.used = stats.capacity - free;
+		stats.fragmentation = free ? 1.0f - float(stats.largestFree) / float(free) : 0.0f;
+		return stats;
+	}
+
+	BufferHeap::Page& BufferHeap::addPage(u32 units) {
+		Page page;
+		page.buffer = Buffer().create(m_type).bind();
+		page.buffer.reserve(size_t(units) * m_alignment, m_usage);
+		page.allocator.reset(units);
+		m_pages.push_back(std::move(page));
+		return m_pages.back();
+	}
+
+}
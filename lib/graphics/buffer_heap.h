@@ -0,0 +1,129 @@
+#ifndef BUFFER_HEAP_H
+#define BUFFER_HEAP_H
+
+#include "buffer.h"
+
+namespace gt {
+	// Two-level segregated fit allocator over a range of units. It only hands
+	// out offsets, the memory lives elsewhere. Allocation and free are O(1):
+	// free blocks sit in size classes of 16 steps per power of two, found with
+	// two bitmap scans, and neighbours are merged on free.
+	class OffsetAllocator {
+	public:
+		static constexpr u32 Invalid = ~0u;
+
+		struct Allocation {
+			u32 offset{ Invalid }, size{ 0 };
+			u32 node{ Invalid };
+
+			bool valid() const { return node != Invalid; }
+		};
+
+		OffsetAllocator() = default;
+		explicit OffsetAllocator(u32 size) { reset(size); }
+
+		void reset(u32 size);
+
+		Allocation allocate(u32 size);
+		void free(const Allocation& allocation);
+
+		u32 size() const { return m_size; }
+		u32 freeSize() const { return m_free; }
+		u32 largestFree() const;
+		u32 allocationCount() const { return m_allocations; }
+		u32 freeBlockCount() const { return m_freeBlocks; }
+
+	private:
+		static constexpr u32 SecondBits = 4;
+		static constexpr u32 SecondCount = 1 << SecondBits;
+		static constexpr u32 FirstCount = 32 - SecondBits + 1;
+
+		struct Block {
+			u32 offset, size;
+			u32 prev, next;         // physical neighbours
+			u32 prevFree, nextFree; // size class list
+			bool used;
+		};
+
+		std::vector<Block> m_blocks;
+		std::vector<u32> m_unusedBlocks;
+		u32 m_heads[FirstCount][SecondCount];
+		u32 m_firstMap{ 0 }, m_secondMap[FirstCount];
+
+		u32 m_size{ 0 }, m_free{ 0 }, m_allocations{ 0 }, m_freeBlocks{ 0 };
+
+		u32 newBlock();
+		void insert(u32 block);
+		void remove(u32 block);
+		u32 findFree(u32 size) const;
+	};
+
+	// A few large GL buffers shared by many small logical ones. Allocations are
+	// aligned to `alignment` bytes, so vertex allocations can use an alignment
+	// of the vertex stride and be drawn from one VAO with
+	// baseVertex = offset / stride. Uniform and storage heaps are rounded up to
+	// the offset alignment GL requires for bindRange(). A new page is added when
+	// no page has room.
+	class BufferHeap {
+	public:
+		struct Allocation {
+			u32 page{ 0 }, offset{ 0 }, size{ 0 };
+			OffsetAllocator::Allocation range;
+
+			bool valid() const { return range.valid(); }
+			// Element index of the allocation in a buffer of `stride` sized elements.
+			u32 first(u32 stride) const { return offset / stride; }
+		};
+
+		struct Stats {
+			u32 pages, capacity, used;
+			u32 allocations, freeBlocks, largestFree;
+			// 0 when all free space is one block, close to 1 when it is scattered.
+			float fragmentation;
+		};
+
+		BufferHeap() = default;
+		~BufferHeap();
+
+		BufferHeap(const BufferHeap&) = delete;
+		BufferHeap& operator=(const BufferHeap&) = delete;
+
+		BufferHeap& create(
+			Buffer::BufferType type,
+			u32 pageSize,
+			u32 alignment = 16,
+			Buffer::BufferUsage usage = Buffer::StaticDraw
+		);
+		void destroy();
+
+		Allocation allocate(u32 size);
+		void free(Allocation& allocation);
+
+		// `offset` is relative to the allocation.
+		BufferHeap& update(const Allocation& allocation, const void* data, u32 size, u32 offset = 0);
+		BufferHeap& bindRange(const Allocation& allocation, u32 bindingPoint);
+
+		Buffer& buffer(const Allocation& allocation) { return m_pages[allocation.page].buffer; }
+		Buffer& page(u32 index) { return m_pages[index].buffer; }
+		u32 pageCount() const { return m_pages.size(); }
+		u32 alignment() const { return m_alignment; }
+
+		Stats stats() const;
+
+	private:
+		struct Page {
+			Buffer buffer;
+			OffsetAllocator allocator;
+		};
+
+		Buffer::BufferType m_type{ Buffer::ArrayBuffer };
+		Buffer::BufferUsage m_usage{ Buffer::StaticDraw };
+		u32 m_pageUnits{ 0 }, m_alignment{ 1 };
+
+		std::vector<Page> m_pages;
+
+		Page& addPage(u32 units);
+	};
+}
+
+#endif // BUFFER_HEAP_H
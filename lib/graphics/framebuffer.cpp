@@ -1,10 +1,12 @@
 #include "framebuffer.h"
+#include "gl_state.h"
 
 #include <iostream>
 
 namespace gt {
 	void FrameBuffer::destroy() {
 		if (m_id) {
+			GLState::get().forgetFramebuffer(m_id);
 			glDeleteFramebuffers(1, &m_id);
 			m_id = 0;
 		}
@@ -29,7 +31,7 @@ namespace gt {
 		bool floatingPoint,
 		u32 depthSize, u32 mip, u32 layer
 	) {
-		glBindFramebuffer(GL_FRAMEBUFFER, m_id);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, m_id);
 
 		DataType dt = floatingPoint ? DataType::TypeFloat : DataType::TypeUByte;
 		Texture tex{};
@@ -88,7 +90,7 @@ namespace gt {
 		}
 
 		m_colorAttachments.push_back(tex);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, 0);
 
 		return *this;
 	}
@@ -98,7 +100,7 @@ namespace gt {
 			return *this;
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, m_id);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, m_id);
 
 		Texture tex{};
 		tex.create(TextureType::Texture2D, Format::Depth, m_width, m_height, 1, true, depthSize).bind()
@@ -114,7 +116,7 @@ namespace gt {
 		);
 
 		m_depthAttachment = tex;
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, 0);
 
 		return *this;
 	}
@@ -124,7 +126,7 @@ namespace gt {
 			return *this;
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, m_id);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, m_id);
 
 		Texture tex{};
 		tex.create(TextureType::Texture2D, Format::R, m_width, m_height, 1, true).bind()
@@ -140,7 +142,7 @@ namespace gt {
 		);
 
 		m_stencilAttachment = tex;
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, 0);
 
 		return *this;
 	}
@@ -159,7 +161,7 @@ namespace gt {
 		GLenum ifmt = getInternalFormat(storage, floatingPoint, depthSize);
 		glGenRenderbuffers(1, &m_rboID);
 
-		glBindFramebuffer(GL_FRAMEBUFFER, m_id);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, m_id);
 		glBindRenderbuffer(GL_RENDERBUFFER, m_rboID);
 		glRenderbufferStorage(GL_RENDERBUFFER, ifmt, m_width, m_height);
 		glFramebufferRenderbuffer(
@@ -174,11 +176,11 @@ namespace gt {
 		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 			glDeleteRenderbuffers(1, &m_rboID);
 			m_rboID = 0;
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			GLState::get().framebuffer(GL_FRAMEBUFFER, 0);
 
 			return *this;
 		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::get().framebuffer(GL_FRAMEBUFFER, 0);
 
 		return *this;
 	}
@@ -207,9 +209,9 @@ namespace gt {
 
 	FrameBuffer& FrameBuffer::bind(FrameBufferTarget target, Attachment readBuffer) {
 		m_bound = target;
-		glGetIntegerv(GL_VIEWPORT, m_viewport);
-		glBindFramebuffer(target, m_id);
-		glViewport(0, 0, m_width, m_height);
+		GLState::get().viewport(m_viewport);
+		GLState::get().framebuffer(target, m_id);
+		GLState::get().viewport(0, 0, m_width, m_height);
 		if (target == FrameBufferTarget::ReadFrameBuffer) {
 			glReadBuffer(readBuffer);
 		}
@@ -217,9 +219,9 @@ namespace gt {
 	}
 
 	FrameBuffer& FrameBuffer::unbind(bool resetViewport) {
-		glBindFramebuffer(m_bound, 0);
+		GLState::get().framebuffer(m_bound, 0);
 		if (resetViewport) {
-			glViewport(
+			GLState::get().viewport(
 				m_viewport[0],
 				m_viewport[1],
 				m_viewport[2],
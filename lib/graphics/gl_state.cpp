@@ -0,0 +1,252 @@
+#include "gl_state.h"
+#include "vertex_array_cache.h"
+
+#include <algorithm>
+
+namespace gt {
+
+	GLState& GLState::get() {
+		thread_local GLState state;
+		return state;
+	}
+
+	GLState::GLState() {
+		invalidate();
+	}
+
+	void GLState::invalidate(bool contextLost) {
+		VertexArrayCache::get().invalidate(contextLost);
+		if (contextLost) m_programGeneration++;
+		m_program = m_vertexArray = Unknown;
+		m_drawFramebuffer = m_readFramebuffer = Unknown;
+		std::fill(std::begin(m_buffers), std::end(m_buffers), Unknown);
+		m_units.clear();
+		m_activeUnit = Unknown;
+		m_blend = m_depthTest = m_depthMask = m_cullFace = -1;
+		std::fill(std::begin(m_blendFunc), std::end(m_blendFunc), Unknown);
+		m_depthFunc = m_frontFace = Unknown;
+		std::fill(std::begin(m_viewport), std::end(m_viewport), -1);
+	}
+
+	bool GLState::changed(bool same) {
+		if (same) {
+			m_redundant++;
+			return false;
+		}
+		m_issued++;
+		return true;
+	}
+
+	bool GLState::toggle(i8& state, bool enabled) {
+		if (!changed(state == i8(enabled))) return false;
+		state = enabled;
+		return true;
+	}
+
+	i32 GLState::bufferIndex(GLenum target) {
+		switch (target) {
+			case GL_ARRAY_BUFFER: return 0;
+			case GL_ELEMENT_ARRAY_BUFFER: return 1;
+			case GL_UNIFORM_BUFFER: return 2;
+			case GL_SHADER_STORAGE_BUFFER: return 3;
+			case GL_DRAW_INDIRECT_BUFFER: return 4;
+			case GL_DISPATCH_INDIRECT_BUFFER: return 5;
+			case GL_COPY_READ_BUFFER: return 6;
+			case GL_COPY_WRITE_BUFFER: return 7;
+			case GL_PIXEL_PACK_BUFFER: return 8;
+			case GL_PIXEL_UNPACK_BUFFER: return 9;
+			default: return -1;
+		}
+	}
+
+	i32 GLState::textureIndex(GLenum target) {
+		switch (target) {
+			case GL_TEXTURE_1D: return 0;
+			case GL_TEXTURE_2D: return 1;
+			case GL_TEXTURE_3D: return 2;
+			case GL_TEXTURE_CUBE_MAP: return 3;
+			case GL_TEXTURE_2D_ARRAY: return 4;
+			default: return -1;
+		}
+	}
+
+	GLState::TextureUnit& GLState::unit(u32 index) {
+		if (index >= m_units.size()) {
+			TextureUnit unknown;
+			unknown.fill(Unknown);
+			m_units.resize(index + 1, unknown);
+		}
+		return m_units[index];
+	}
+
+	void GLState::program(GLuint id) {
+		if (!changed(m_program == id)) return;
+		glUseProgram(id);
+		m_program = id;
+	}
+
+	void GLState::vertexArray(GLuint id) {
+		if (!changed(m_vertexArray == id)) return;
+		glBindVertexArray(id);
+		m_vertexArray = id;
+		// the element buffer binding belongs to the vertex array
+		m_buffers[bufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = Unknown;
+	}
+
+	void GLState::buffer(GLenum target, GLuint id) {
+		const i32 i = bufferIndex(target);
+		if (!changed(i >= 0 && m_buffers[i] == id)) return;
+		glBindBuffer(target, id);
+		if (i >= 0) m_buffers[i] = id;
+	}
+
+	void GLState::bufferBase(GLenum target, u32 index, GLuint id) {
+		m_issued++;
+		glBindBufferBase(target, index, id);
+		// binds the generic target as well
+		const i32 i = bufferIndex(target);
+		if (i >= 0) m_buffers[i] = id;
+	}
+
+	void GLState::bufferRange(GLenum target, u32 index, GLuint id, u32 offset, u32 size) {
+		m_issued++;
+		glBindBufferRange(target, index, id, offset, size);
+		const i32 i = bufferIndex(target);
+		if (i >= 0) m_buffers[i] = id;
+	}
+
+	void GLState::framebuffer(GLenum target, GLuint id) {
+		bool same = false;
+		switch (target) {
+			case GL_DRAW_FRAMEBUFFER: same = m_drawFramebuffer == id; break;
+			case GL_READ_FRAMEBUFFER: same = m_readFramebuffer == id; break;
+			default: same = m_drawFramebuffer == id && m_readFramebuffer == id; break;
+		}
+		if (!changed(same)) return;
+		glBindFramebuffer(target, id);
+		if (target != GL_READ_FRAMEBUFFER) m_drawFramebuffer = id;
+		if (target != GL_DRAW_FRAMEBUFFER) m_readFramebuffer = id;
+	}
+
+	void GLState::activeTexture(u32 unit) {
+		if (!changed(m_activeUnit == unit)) return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		m_activeUnit = unit;
+	}
+
+	void GLState::texture(u32 index, GLenum target, GLuint id) {
+		activeTexture(index);
+		const i32 i = textureIndex(target);
+		if (i < 0) {
+			m_issued++;
+			glBindTexture(target, id);
+			return;
+		}
+		GLuint& bound = unit(index)[i];
+		if (!changed(bound == id)) return;
+		glBindTexture(target, id);
+		bound = id;
+	}
+
+	void GLState::texture(GLenum target, GLuint id) {
+		if (m_activeUnit == Unknown) {
+			GLint active = 0;
+			glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+			m_activeUnit = active - GL_TEXTURE0;
+		}
+		texture(m_activeUnit, target, id);
+	}
+
+	void GLState::blend(bool enabled) {
+		if (!toggle(m_blend, enabled)) return;
+		if (enabled) glEnable(GL_BLEND);
+		else glDisable(GL_BLEND);
+	}
+
+	void GLState::blendFunc(GLenum srcColor, GLenum dstColor, GLenum srcAlpha, GLenum dstAlpha) {
+		const bool same =
+			m_blendFunc[0] == srcColor && m_blendFunc[1] == dstColor &&
+			m_blendFunc[2] == srcAlpha && m_blendFunc[3] == dstAlpha;
+		if (!changed(same)) return;
+		glBlendFuncSeparate(srcColor, dstColor, srcAlpha, dstAlpha);
+		m_blendFunc[0] = srcColor;
+		m_blendFunc[1] = dstColor;
+		m_blendFunc[2] = srcAlpha;
+		m_blendFunc[3] = dstAlpha;
+	}
+
+	void GLState::depthTest(bool enabled) {
+		if (!toggle(m_depthTest, enabled)) return;
+		if (enabled) glEnable(GL_DEPTH_TEST);
+		else glDisable(GL_DEPTH_TEST);
+	}
+
+	void GLState::depthMask(bool enabled) {
+		if (!toggle(m_depthMask, enabled)) return;
+		glDepthMask(enabled);
+	}
+
+	void GLState::depthFunc(GLenum func) {
+		if (!changed(m_depthFunc == func)) return;
+		glDepthFunc(func);
+		m_depthFunc = func;
+	}
+
+	void GLState::cullFace(bool enabled) {
+		if (!toggle(m_cullFace, enabled)) return;
+		if (enabled) glEnable(GL_CULL_FACE);
+		else glDisable(GL_CULL_FACE);
+	}
+
+	void GLState::frontFace(GLenum mode) {
+		if (!changed(m_frontFace == mode)) return;
+		glFrontFace(mode);
+		m_frontFace = mode;
+	}
+
+	void GLState::viewport(i32 x, i32 y, i32 width, i32 height) {
+		const bool same =
+			m_viewport[0] == x && m_viewport[1] == y &&
+			m_viewport[2] == width && m_viewport[3] == height;
+		if (!changed(same)) return;
+		glViewport(x, y, width, height);
+		m_viewport[0] = x;
+		m_viewport[1] = y;
+		m_viewport[2] = width;
+		m_viewport[3] = height;
+	}
+
+	void GLState::viewport(i32* out) {
+		if (m_viewport[2] < 0) glGetIntegerv(GL_VIEWPORT, m_viewport);
+		std::copy(std::begin(m_viewport), std::end(m_viewport), out);
+	}
+
+	void GLState::forgetBuffer(GLuint id) {
+		for (GLuint& bound : m_buffers) {
+			if (bound == id) bound = 0;
+		}
+	}
+
+	void GLState::forgetTexture(GLuint id) {
+		for (TextureUnit& u : m_units) {
+			for (GLuint& bound : u) {
+				if (bound == id) bound = 0;
+			}
+		}
+	}
+
+	void GLState::forgetVertexArray(GLuint id) {
+		if (m_vertexArray == id) m_vertexArray = 0;
+	}
+
+	void GLState::forgetFramebuffer(GLuint id) {
+		if (m_drawFramebuffer == id) m_drawFramebuffer = 0;
+		if (m_readFramebuffer == id) m_readFramebuffer = 0;
+	}
+
+	void GLState::forgetProgram(GLuint id) {
+		if (m_program == id) m_program = 0;
+		m_programGeneration++;
+	}
+
+}
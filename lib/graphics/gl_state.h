@@ -0,0 +1,90 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <array>
+#include <vector>
+
+#include "../stl.hpp"
+#include "../glad/glad.h"
+
+namespace gt {
+	// Shadow copy of the GL state touched by the gt wrappers. Calls that
+	// wouldn't change anything are skipped and counted. There is one per
+	// thread, matching the context current on it. Code that changes state
+	// behind its back (raw GL, other libraries) must call invalidate(), and
+	// invalidate(true) after the context was lost or recreated.
+	class GLState {
+	public:
+		static GLState& get();
+
+		void program(GLuint id);
+		void vertexArray(GLuint id);
+		void buffer(GLenum target, GLuint id);
+		void bufferBase(GLenum target, u32 index, GLuint id);
+		void bufferRange(GLenum target, u32 index, GLuint id, u32 offset, u32 size);
+		void framebuffer(GLenum target, GLuint id);
+
+		// Leaves `unit` active, so the texture can be edited right after.
+		void texture(u32 unit, GLenum target, GLuint id);
+		void texture(GLenum target, GLuint id);
+		void activeTexture(u32 unit);
+
+		void blend(bool enabled);
+		void blendFunc(GLenum srcColor, GLenum dstColor, GLenum srcAlpha, GLenum dstAlpha);
+		void depthTest(bool enabled);
+		void depthMask(bool enabled);
+		void depthFunc(GLenum func);
+		void cullFace(bool enabled);
+		void frontFace(GLenum mode);
+
+		void viewport(i32 x, i32 y, i32 width, i32 height);
+		void viewport(i32* out);
+
+		// GL unbinds deleted objects, so the wrappers report them here.
+		void forgetBuffer(GLuint id);
+		void forgetTexture(GLuint id);
+		void forgetVertexArray(GLuint id);
+		void forgetFramebuffer(GLuint id);
+		void forgetProgram(GLuint id);
+
+		// Bumped whenever a program is deleted or the context is lost, so
+		// caches keyed by program id know when an id may have been reused.
+		u32 programGeneration() const { return m_programGeneration; }
+
+		void invalidate(bool contextLost = false);
+
+		u32 issuedCalls() const { return m_issued; }
+		u32 redundantCalls() const { return m_redundant; }
+		void resetCounters() { m_issued = m_redundant = 0; }
+
+	private:
+		static constexpr GLuint Unknown = ~0u;
+		static constexpr u32 BufferTargets = 10;
+		static constexpr u32 TextureTargets = 5;
+
+		using TextureUnit = std::array<GLuint, TextureTargets>;
+
+		GLuint m_program, m_vertexArray, m_drawFramebuffer, m_readFramebuffer;
+		GLuint m_buffers[BufferTargets];
+		std::vector<TextureUnit> m_units;
+		u32 m_activeUnit;
+
+		i8 m_blend, m_depthTest, m_depthMask, m_cullFace;
+		GLenum m_blendFunc[4], m_depthFunc, m_frontFace;
+		i32 m_viewport[4];
+
+		u32 m_issued{ 0 }, m_redundant{ 0 };
+		u32 m_programGeneration{ 0 };
+
+		GLState();
+
+		bool changed(bool same);
+		bool toggle(i8& state, bool enabled);
+		TextureUnit& unit(u32 index);
+
+		static i32 bufferIndex(GLenum target);
+		static i32 textureIndex(GLenum target);
+	};
+}
+
+#endif // GL_STATE_H
@@ -0,0 +1,222 @@
+#include "gpu_sprite_layer.h"
+#include "vertex_array_cache.h"
+#include "gl_state.h"
+
+#include <algorithm>
+
+namespace gt {
+
+	static constexpr u32 MergeGap = 16;
+	static constexpr u32 LocalSize = 64;
+
+	static const std::string CullShader = R"(#version 430 core
+layout (local_size_x = 64) in;
+
+struct Command {
+	uint count, instanceCount, firstIndex, baseVertex, baseInstance;
+};
+
+// SpriteBatch::Instance, 14 words
+layout (std430, binding = 0) readonly buffer Input { uint inData[]; };
+layout (std430, binding = 1) writeonly buffer Output { uint outData[]; };
+layout (std430, binding = 2) buffer Commands { Command commands[]; };
+
+uniform vec4 uViewRect;
+uniform int uCount;
+
+const uint Stride = 14u;
+
+vec2 read2(uint i) {
+	return vec2(uintBitsToFloat(inData[i]), uintBitsToFloat(inData[i + 1u]));
+}
+
+bool visible(vec2 position, float rotation, vec2 lo, vec2 hi) {
+	float r = length(max(abs(lo), abs(hi)));
+	if (any(lessThan(position + r, uViewRect.xy)) || any(greaterThan(position - r, uViewRect.zw))) return false;
+	if (all(greaterThanEqual(position - r, uViewRect.xy)) && all(lessThanEqual(position + r, uViewRect.zw))) return true;
+
+	float c = cos(rotation), s = sin(rotation);
+	vec2 o = (lo + hi) * 0.5;
+	vec2 h = abs(hi - lo) * 0.5;
+	vec2 center = position + vec2(c * o.x - s * o.y, s * o.x + c * o.y);
+	vec2 extent = vec2(abs(c) * h.x + abs(s) * h.y, abs(s) * h.x + abs(c) * h.y);
+	return !(any(lessThan(center + extent, uViewRect.xy)) || any(greaterThan(center - extent, uViewRect.zw)));
+}
+
+void main() {
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= uint(uCount)) return;
+
+	uint src = id * Stride;
+	vec2 size = read2(src + 2u);
+	if (size == vec2(0.0)) return;
+
+	vec2 origin = read2(src + 4u);
+	if (!visible(read2(src), uintBitsToFloat(inData[src + 6u]), -origin * size, (1.0 - origin) * size)) return;
+
+	uint word = inData[src + 12u];
+	uint bucket = word & 0xFFFFu;
+	uint dst = (commands[bucket].baseInstance + atomicAdd(commands[bucket].instanceCount, 1u)) * Stride;
+	for (uint i = 0u; i < Stride; i++) {
+		outData[dst + i] = inData[src + i];
+	}
+	// every bucket draws with its texture bound to slot 0
+	outData[dst + 12u] = word & 0xFFFF0000u;
+})";
+
+	GpuSpriteLayer::GpuSpriteLayer(const SpriteBatch& batch, u32 capacity) {
+		m_capacity = std::max(capacity, 1u);
+		m_data.resize(m_capacity);
+		m_bucketOf.resize(m_capacity);
+		m_resized = true;
+
+		m_cull = Shader().create().add(CullShader, Shader::ComputeShader).link();
+
+		m_input = Buffer().create(Buffer::ShaderStorageBuffer);
+		m_commands = Buffer().create(Buffer::DrawIndirectBuffer);
+		m_commands.bind().streamPolicy(Buffer::PolicyOrphan);
+
+		m_format = batch.vertexFormat();
+		m_output = Buffer().create(Buffer::ArrayBuffer);
+		m_ibo = Buffer().create(Buffer::ElementBuffer);
+		VertexArrayCache::get().bind(m_format, m_output, m_ibo);
+		m_ibo.bind().update(std::vector<u32>{ 0, 1, 2, 0, 2, 3 }, Buffer::StaticDraw);
+	}
+
+	GpuSpriteLayer::~GpuSpriteLayer() {
+		m_input.destroy();
+		m_output.destroy();
+		m_ibo.destroy();
+		m_commands.destroy();
+		m_cull.destroy();
+	}
+
+	u32 GpuSpriteLayer::bucket(const Texture& texture) {
+		for (u32 i = 0; i < m_buckets.size(); i++) {
+			if (m_buckets[i].texture.id() == texture.id()) return i;
+		}
+		m_buckets.push_back({ texture, 0, 0 });
+		return m_buckets.size() - 1;
+	}
+
+	GpuSpriteLayer::Handle GpuSpriteLayer::add(const Texture& texture, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		return add(texture, 0, position, rotation, origin, scale, uv);
+	}
+
+	GpuSpriteLayer::Handle GpuSpriteLayer::add(const Texture& texture, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		Handle handle;
+		if (!m_free.empty()) {
+			handle = m_free.back();
+			m_free.pop_back();
+		} else {
+			if (m_count == m_capacity) {
+				m_capacity *= 2;
+				m_data.resize(m_capacity);
+				m_bucketOf.resize(m_capacity);
+				m_resized = true;
+			}
+			handle = m_count++;
+		}
+		const u32 b = bucket(texture);
+		m_buckets[b].count++;
+		m_bucketOf[handle] = b;
+		write(handle, arrayLayer, position, rotation, origin, scale, uv);
+		return handle;
+	}
+
+	void GpuSpriteLayer::update(Handle handle, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		if (!alive(handle)) return;
+		write(handle, m_data[handle].layer, position, rotation, origin, scale, uv);
+	}
+
+	void GpuSpriteLayer::remove(Handle handle) {
+		if (!alive(handle)) return;
+		m_buckets[m_bucketOf[handle]].count--;
+		m_bucketOf[handle] = Dead;
+		// the cull pass skips zero sized sprites
+		m_data[handle] = SpriteBatch::Instance{};
+		invalidate(handle);
+		m_free.push_back(handle);
+	}
+
+	void GpuSpriteLayer::clear() {
+		m_count = 0;
+		m_free.clear();
+		m_input.clearDirty();
+		m_buckets.clear();
+	}
+
+	void GpuSpriteLayer::write(Handle handle, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		const Texture& texture = m_buckets[m_bucketOf[handle]].texture;
+		const float tw = texture.width() * uv.z;
+		const float th = texture.height() * uv.w;
+		SpriteBatch::writeInstance(
+			reinterpret_cast<u8*>(&m_data[handle]),
+			position, Vector2(tw * scale.x, th * scale.y), origin, rotation,
+			uv, m_color, m_bucketOf[handle], arrayLayer, 0.0f
+		);
+		invalidate(handle);
+	}
+
+	void GpuSpriteLayer::invalidate(Handle handle) {
+		if (m_resized) return;
+		m_input.markDirty(handle * sizeof(SpriteBatch::Instance), sizeof(SpriteBatch::Instance));
+	}
+
+	u32 GpuSpriteLayer::upload() {
+		const u32 stride = sizeof(SpriteBatch::Instance);
+		u32 bytes = 0;
+		if (m_resized) {
+			m_input.bind().update(m_data.data(), m_data.size(), Buffer::StaticDraw);
+			bytes = m_data.size() * stride;
+			m_output.bind().update<u8>(nullptr, m_capacity * stride, Buffer::StreamCopy);
+		} else if (m_input.dirty()) {
+			bytes = m_input.bind().uploadDirty(m_data.data(), MergeGap * stride);
+		}
+		m_input.clearDirty();
+		m_resized = false;
+		return bytes;
+	}
+
+	u32 GpuSpriteLayer::cull(const Vector4& viewRect) {
+		const u32 bytes = upload();
+
+		// buckets own contiguous ranges of the output, sized for all their sprites
+		std::vector<Command> commands;
+		commands.reserve(m_buckets.size());
+		u32 base = 0;
+		for (auto&& b : m_buckets) {
+			b.base = base;
+			commands.push_back({ 6, 0, 0, 0, base });
+			base += b.count;
+		}
+		m_commands.bind().update(commands, Buffer::StreamDraw);
+
+		m_input.bindBase(0);
+		GLState::get().bufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_output.id());
+		GLState::get().bufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_commands.id());
+
+		m_cull.bind();
+		m_cull.get("uViewRect").set(viewRect);
+		m_cull.get("uCount").set(i32(m_count));
+		m_cull.dispatch((m_count + LocalSize - 1) / LocalSize);
+		m_cull.unbind();
+
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		return bytes + commands.size() * sizeof(Command);
+	}
+
+	u32 GpuSpriteLayer::visibleCount() {
+		if (m_buckets.empty()) return 0;
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		std::vector<Command> commands(m_buckets.size());
+		m_commands.bind();
+		glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(Command), commands.data());
+
+		u32 visible = 0;
+		for (auto&& cmd : commands) visible += cmd.instanceCount;
+		return visible;
+	}
+
+}
@@ -0,0 +1,97 @@
+#ifndef GPU_SPRITE_LAYER_H
+#define GPU_SPRITE_LAYER_H
+
+#include "sprite_batch.h"
+
+namespace gt {
+	// Retained sprites culled on the GPU. A compute pass tests every instance
+	// against the view, compacts the survivors per texture bucket and fills the
+	// indirect commands, so drawing costs one glDrawElementsIndirect per texture.
+	// Needs GL 4.3 and an instanced SpriteBatch.
+	class GpuSpriteLayer {
+	public:
+		using Handle = u32;
+
+		GpuSpriteLayer(const SpriteBatch& batch, u32 capacity = 4096);
+		~GpuSpriteLayer();
+
+		Handle add(
+			const Texture& texture,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		Handle add(
+			const Texture& texture,
+			u32 arrayLayer,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		void update(
+			Handle handle,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		void remove(Handle handle);
+		void clear();
+
+		const Vector4& color() const { return m_color; }
+		void color(const Vector4& col) { m_color = col; }
+
+		u32 count() const { return m_count - m_free.size(); }
+		u32 capacity() const { return m_capacity; }
+		u32 bucketCount() const { return m_buckets.size(); }
+
+		// Sprites that survived the last cull. Reads the commands back, so it stalls.
+		u32 visibleCount();
+
+	private:
+		friend class SpriteBatch;
+
+		// m_bucketOf entry of removed handles
+		static constexpr u16 Dead = 0xFFFF;
+
+		struct Bucket {
+			Texture texture;
+			u32 count, base;
+		};
+
+		struct Command {
+			u32 count, instanceCount, firstIndex, baseVertex, baseInstance;
+		};
+
+		Shader m_cull;
+		VertexFormat m_format;
+		Buffer m_input, m_output, m_ibo, m_commands;
+
+		std::vector<SpriteBatch::Instance> m_data;
+		std::vector<u16> m_bucketOf;
+		std::vector<Bucket> m_buckets;
+		std::vector<Handle> m_free;
+		u32 m_count{ 0 }, m_capacity{ 0 };
+		bool m_resized{ false };
+
+		Vector4 m_color{ 1.0f };
+
+		bool alive(Handle handle) const { return handle < m_count && m_bucketOf[handle] != Dead; }
+		u32 bucket(const Texture& texture);
+		void write(Handle handle, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv);
+		void invalidate(Handle handle);
+		// Both return the bytes sent to the GPU.
+		u32 upload();
+		u32 cull(const Vector4& viewRect);
+	};
+}
+
+#endif // GPU_SPRITE_LAYER_H
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "../log.h"
+#include "gl_state.h"
 
 namespace gt {
 
@@ -11,6 +12,7 @@ namespace gt {
 		if (m_id) {
 			unbind();
 			glDeleteProgram(m_id);
+			GLState::get().forgetProgram(m_id);
 		}
 	}
 
@@ -20,12 +22,12 @@ namespace gt {
 	}
 
 	Shader& Shader::bind() {
-		glUseProgram(m_id);
+		GLState::get().program(m_id);
 		return *this;
 	}
 
 	Shader& Shader::unbind() {
-		glUseProgram(0);
+		GLState::get().program(0);
 		return *this;
 	}
 
@@ -53,6 +55,11 @@ namespace gt {
 		return *this;
 	}
 
+	Shader& Shader::dispatch(u32 x, u32 y, u32 z) {
+		glDispatchCompute(x, y, z);
+		return *this;
+	}
+
 	i32 Shader::getBlockIndex(Shader::ProgramInterface inter, const std::string& name) {
 		auto pos = m_blockIndices.find(name);
 		if (pos == m_blockIndices.end()) {
@@ -104,6 +111,16 @@ namespace gt {
 		return m_attributes[name];
 	}
 
+	i32 Shader::getUniformSize(const std::string& name) {
+		GLuint index = glGetProgramResourceIndex(m_id, GL_UNIFORM, name.c_str());
+		if (index == GL_INVALID_INDEX) return 0;
+
+		const GLenum prop = GL_ARRAY_SIZE;
+		GLint size = 0;
+		glGetProgramResourceiv(m_id, GL_UNIFORM, index, 1, &prop, 1, nullptr, &size);
+		return size;
+	}
+
 	void Shader::uniformBlockBinding(u32 blockIndex, u32 binding) {
 		glUniformBlockBinding(m_id, blockIndex, binding);
 	}
@@ -116,6 +133,10 @@ namespace gt {
 		glUniform1i(loc, v);
 	}
 
+	void Shader::Uniform::set(const i32* v, u32 count) {
+		glUniform1iv(loc, count, v);
+	}
+
 	void Shader::Uniform::set(float v) {
 		glUniform1f(loc, v);
 	}
@@ -26,6 +26,7 @@ namespace gt {
 		struct Uniform {
 			u32 loc;
 			void set(i32 v);
+			void set(const i32* v, u32 count);
 			void set(float v);
 			void set(const Vector2& v);
 			void set(const Vector3& v);
@@ -49,9 +50,12 @@ namespace gt {
 		Shader& add(const std::string& source, ShaderType type);
 		Shader& link();
 
+		Shader& dispatch(u32 x, u32 y = 1, u32 z = 1);
+
 		i32 getBlockIndex(ProgramInterface interface, const std::string& name);
 		i32 getUniformIndex(const std::string& name);
 		i32 getAttributeIndex(const std::string& name);
+		i32 getUniformSize(const std::string& name);
 
 		void uniformBlockBinding(u32 blockIndex, u32 binding);
 		void storageBlockBinding(u32 blockIndex, u32 binding);
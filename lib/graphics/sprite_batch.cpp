@@ -1,8 +1,40 @@
 #include "sprite_batch.h"
+#include "sprite_layer.h"
+#include "gpu_sprite_layer.h"
+#include "gl_state.h"
+#include "sprite_mesh.h"
+#include "sprite_command_list.h"
+#include "vertex_array_cache.h"
+
+#include "../log.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GT_SPRITE_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define GT_SPRITE_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define GT_SPRITE_AVX2
+#endif
+#endif
 
 namespace gt {
 
-	static const std::string FS = R"(#version 430 core
+	static std::string fragmentShader(bool array) {
+		const std::string sampler = array ? "sampler2DArray" : "sampler2D";
+		const std::string coord = array ? "vec3(uv, float(vsTextureLayer))" : "uv";
+
+		std::string cases;
+		for (u32 i = 0; i < TextureSlots; i++) {
+			const std::string n = std::to_string(i);
+			cases += "\t\tcase " + n + ": return textureGrad(uTextures[" + n + "], " + coord + ", dx, dy);\n";
+		}
+
+		return R"(#version 430 core
 out vec4 fragColor;
 
 in DATA {
@@ -12,140 +44,1418 @@ in DATA {
 	mat3 tbn;
 } VS;
 
-uniform sampler2D uTexture;
+flat in int vsTextureSlot;
+flat in int vsTextureLayer;
+
+uniform )" + sampler + " uTextures[" + std::to_string(TextureSlots) + R"(];
+
+vec4 sampleTexture(vec2 uv) {
+	vec2 dx = dFdx(uv);
+	vec2 dy = dFdy(uv);
+	switch (vsTextureSlot) {
+)" + cases + R"(	}
+	return vec4(1.0);
+}
 
 void main() {
 	vec4 col = VS.color;
-	col *= texture(uTexture, VS.uv);
+	col *= sampleTexture(VS.uv);
 	fragColor = col;
 }
 )";
+	}
+
+	static u8 unorm8(float v) {
+		return u8(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	static u16 unorm16(float v) {
+		return u16(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+	}
+
+	static u16 half(float v) {
+		u32 bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		const u32 sign = (bits >> 16) & 0x8000;
+		const i32 exp = i32((bits >> 23) & 0xFF) - 127 + 15;
+		const u32 mantissa = bits & 0x7FFFFF;
+		if (exp <= 0) return u16(sign);
+		if (exp >= 31) return u16(sign | 0x7C00);
+		return u16(sign | ((exp << 10) + ((mantissa + 0x1000) >> 13)));
+	}
+
+	// Per-sprite inputs and outputs of the drawMany kernels, in SoA form.
+	struct SpriteBlock {
+		static constexpr u32 Size = 64;
+		alignas(32) float rotation[Size], px[Size], py[Size];
+		alignas(32) float fx[Size], fy[Size], fx2[Size], fy2[Size];
+		alignas(32) float u1[Size], v1[Size], u2[Size], v2[Size];
+		alignas(32) float r[Size], g[Size], b[Size], a[Size];
+		alignas(32) float z[Size];
+
+		alignas(32) float x[4][Size], y[4][Size];
+		alignas(32) float cos[Size], sin[Size];
+		alignas(32) u32 color[Size], tangent[Size], uv1[Size], uv2[Size];
+	};
+
+	using BlockFunc = void(*)(SpriteBlock&, u32);
+
+#ifndef GT_SPRITE_SSE2
+	static void blockScalar(SpriteBlock& b, u32 count) {
+		for (u32 i = 0; i < count; i++) {
+			const float cos = std::cos(b.rotation[i]);
+			const float sin = std::sin(b.rotation[i]);
+			const float x1 = cos * b.fx[i] - sin * b.fy[i];
+			const float y1 = sin * b.fx[i] + cos * b.fy[i];
+			const float x2 = cos * b.fx[i] - sin * b.fy2[i];
+			const float y2 = sin * b.fx[i] + cos * b.fy2[i];
+			const float x3 = cos * b.fx2[i] - sin * b.fy2[i];
+			const float y3 = sin * b.fx2[i] + cos * b.fy2[i];
+			b.x[0][i] = x1 + b.px[i];
+			b.y[0][i] = y1 + b.py[i];
+			b.x[1][i] = x2 + b.px[i];
+			b.y[1][i] = y2 + b.py[i];
+			b.x[2][i] = x3 + b.px[i];
+			b.y[2][i] = y3 + b.py[i];
+			b.x[3][i] = x1 + (x3 - x2) + b.px[i];
+			b.y[3][i] = y3 - (y2 - y1) + b.py[i];
+			b.cos[i] = cos;
+			b.sin[i] = sin;
+			b.color[i] = u32(unorm8(b.r[i])) | (u32(unorm8(b.g[i])) << 8) | (u32(unorm8(b.b[i])) << 16) | (u32(unorm8(b.a[i])) << 24);
+			b.tangent[i] = u32(half(cos)) | (u32(half(sin)) << 16);
+			b.uv1[i] = u32(unorm16(b.u1[i])) | (u32(unorm16(b.v1[i])) << 16);
+			b.uv2[i] = u32(unorm16(b.u2[i])) | (u32(unorm16(b.v2[i])) << 16);
+		}
+	}
+#endif
+
+#ifdef GT_SPRITE_SSE2
+	static __m128i unorm4(__m128 v, float scale) {
+		v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(scale)), _mm_set1_ps(0.5f)));
+	}
+
+	static __m128i half4(__m128 v) {
+		const __m128i bits = _mm_castps_si128(v);
+		const __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+		const __m128i exp = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xFF)), _mm_set1_epi32(112));
+		const __m128i mantissa = _mm_srli_epi32(_mm_add_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF)), _mm_set1_epi32(0x1000)), 13);
+
+		__m128i h = _mm_add_epi32(_mm_slli_epi32(exp, 10), mantissa);
+		const __m128i inf = _mm_cmpgt_epi32(exp, _mm_set1_epi32(30));
+		h = _mm_or_si128(_mm_andnot_si128(inf, h), _mm_and_si128(inf, _mm_set1_epi32(0x7C00)));
+		h = _mm_andnot_si128(_mm_cmpgt_epi32(_mm_set1_epi32(1), exp), h);
+		return _mm_or_si128(h, sign);
+	}
+
+	// Cephes single precision sincos, accurate to ~1e-7 for |x| < 8192.
+	static void sincos4(__m128 x, __m128& s, __m128& c) {
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(i32(0x80000000)));
+		__m128 sinSign = _mm_and_ps(x, signMask);
+		x = _mm_andnot_ps(signMask, x);
+
+		__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+		j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		const __m128 y = _mm_cvtepi32_ps(j);
+
+		const __m128 swapSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+		const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+		const __m128 poly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+		sinSign = _mm_xor_ps(sinSign, swapSign);
+
+		x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+		x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+		x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+		const __m128 z = _mm_mul_ps(x, x);
+
+		__m128 pc = _mm_set1_ps(2.443315711809948e-5f);
+		pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(-1.388731625493765e-3f));
+		pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(4.166664568298827e-2f));
+		pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+		pc = _mm_add_ps(_mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+		__m128 ps = _mm_set1_ps(-1.9515295891e-4f);
+		ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(8.3321608736e-3f));
+		ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(-1.6666654611e-1f));
+		ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+
+		s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(poly, ps), _mm_andnot_ps(poly, pc)), sinSign);
+		c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(poly, pc), _mm_andnot_ps(poly, ps)), cosSign);
+	}
+
+	static void blockSSE2(SpriteBlock& b, u32 count) {
+		for (u32 i = 0; i < count; i += 4) {
+			__m128 sin, cos;
+			sincos4(_mm_load_ps(b.rotation + i), sin, cos);
+
+			const __m128 fx = _mm_load_ps(b.fx + i);
+			const __m128 fy = _mm_load_ps(b.fy + i);
+			const __m128 fx2 = _mm_load_ps(b.fx2 + i);
+			const __m128 fy2 = _mm_load_ps(b.fy2 + i);
+			const __m128 px = _mm_load_ps(b.px + i);
+			const __m128 py = _mm_load_ps(b.py + i);
+
+			const __m128 x1 = _mm_sub_ps(_mm_mul_ps(cos, fx), _mm_mul_ps(sin, fy));
+			const __m128 y1 = _mm_add_ps(_mm_mul_ps(sin, fx), _mm_mul_ps(cos, fy));
+			const __m128 x2 = _mm_sub_ps(_mm_mul_ps(cos, fx), _mm_mul_ps(sin, fy2));
+			const __m128 y2 = _mm_add_ps(_mm_mul_ps(sin, fx), _mm_mul_ps(cos, fy2));
+			const __m128 x3 = _mm_sub_ps(_mm_mul_ps(cos, fx2), _mm_mul_ps(sin, fy2));
+			const __m128 y3 = _mm_add_ps(_mm_mul_ps(sin, fx2), _mm_mul_ps(cos, fy2));
+
+			_mm_store_ps(b.x[0] + i, _mm_add_ps(x1, px));
+			_mm_store_ps(b.y[0] + i, _mm_add_ps(y1, py));
+			_mm_store_ps(b.x[1] + i, _mm_add_ps(x2, px));
+			_mm_store_ps(b.y[1] + i, _mm_add_ps(y2, py));
+			_mm_store_ps(b.x[2] + i, _mm_add_ps(x3, px));
+			_mm_store_ps(b.y[2] + i, _mm_add_ps(y3, py));
+			_mm_store_ps(b.x[3] + i, _mm_add_ps(_mm_add_ps(x1, _mm_sub_ps(x3, x2)), px));
+			_mm_store_ps(b.y[3] + i, _mm_add_ps(_mm_sub_ps(y3, _mm_sub_ps(y2, y1)), py));
+			_mm_store_ps(b.cos + i, cos);
+			_mm_store_ps(b.sin + i, sin);
+
+			__m128i color = unorm4(_mm_load_ps(b.r + i), 255.0f);
+			color = _mm_or_si128(color, _mm_slli_epi32(unorm4(_mm_load_ps(b.g + i), 255.0f), 8));
+			color = _mm_or_si128(color, _mm_slli_epi32(unorm4(_mm_load_ps(b.b + i), 255.0f), 16));
+			color = _mm_or_si128(color, _mm_slli_epi32(unorm4(_mm_load_ps(b.a + i), 255.0f), 24));
+			_mm_store_si128(reinterpret_cast<__m128i*>(b.color + i), color);
+
+			const __m128i tangent = _mm_or_si128(half4(cos), _mm_slli_epi32(half4(sin), 16));
+			_mm_store_si128(reinterpret_cast<__m128i*>(b.tangent + i), tangent);
+
+			const __m128i uv1 = _mm_or_si128(unorm4(_mm_load_ps(b.u1 + i), 65535.0f), _mm_slli_epi32(unorm4(_mm_load_ps(b.v1 + i), 65535.0f), 16));
+			const __m128i uv2 = _mm_or_si128(unorm4(_mm_load_ps(b.u2 + i), 65535.0f), _mm_slli_epi32(unorm4(_mm_load_ps(b.v2 + i), 65535.0f), 16));
+			_mm_store_si128(reinterpret_cast<__m128i*>(b.uv1 + i), uv1);
+			_mm_store_si128(reinterpret_cast<__m128i*>(b.uv2 + i), uv2);
+		}
+	}
+
+#ifdef GT_SPRITE_AVX2
+	GT_SPRITE_AVX2 static __m256i unorm8x(__m256 v, float scale) {
+		v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(scale)), _mm256_set1_ps(0.5f)));
+	}
+
+	GT_SPRITE_AVX2 static __m256i half8(__m256 v) {
+		const __m256i bits = _mm256_castps_si256(v);
+		const __m256i sign = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(0x8000));
+		const __m256i exp = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(112));
+		const __m256i mantissa = _mm256_srli_epi32(_mm256_add_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFF)), _mm256_set1_epi32(0x1000)), 13);
+
+		__m256i h = _mm256_add_epi32(_mm256_slli_epi32(exp, 10), mantissa);
+		h = _mm256_blendv_epi8(h, _mm256_set1_epi32(0x7C00), _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(30)));
+		h = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(1), exp), h);
+		return _mm256_or_si256(h, sign);
+	}
+
+	GT_SPRITE_AVX2 static void sincos8(__m256 x, __m256& s, __m256& c) {
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(i32(0x80000000)));
+		__m256 sinSign = _mm256_and_ps(x, signMask);
+		x = _mm256_andnot_ps(signMask, x);
+
+		__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+		j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+		const __m256 y = _mm256_cvtepi32_ps(j);
+
+		const __m256 swapSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+		const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+		const __m256 poly = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+		sinSign = _mm256_xor_ps(sinSign, swapSign);
+
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(0.78515625f)));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(2.4187564849853515625e-4f)));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(3.77489497744594108e-8f)));
+		const __m256 z = _mm256_mul_ps(x, x);
+
+		__m256 pc = _mm256_set1_ps(2.443315711809948e-5f);
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(-1.388731625493765e-3f));
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(4.166664568298827e-2f));
+		pc = _mm256_mul_ps(_mm256_mul_ps(pc, z), z);
+		pc = _mm256_add_ps(_mm256_sub_ps(pc, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+		__m256 ps = _mm256_set1_ps(-1.9515295891e-4f);
+		ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(8.3321608736e-3f));
+		ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(-1.6666654611e-1f));
+		ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), x), x);
+
+		s = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, poly), sinSign);
+		c = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, poly), cosSign);
+	}
+
+	GT_SPRITE_AVX2 static void blockAVX2(SpriteBlock& b, u32 count) {
+		for (u32 i = 0; i < count; i += 8) {
+			__m256 sin, cos;
+			sincos8(_mm256_load_ps(b.rotation + i), sin, cos);
+
+			const __m256 fx = _mm256_load_ps(b.fx + i);
+			const __m256 fy = _mm256_load_ps(b.fy + i);
+			const __m256 fx2 = _mm256_load_ps(b.fx2 + i);
+			const __m256 fy2 = _mm256_load_ps(b.fy2 + i);
+			const __m256 px = _mm256_load_ps(b.px + i);
+			const __m256 py = _mm256_load_ps(b.py + i);
+
+			const __m256 x1 = _mm256_sub_ps(_mm256_mul_ps(cos, fx), _mm256_mul_ps(sin, fy));
+			const __m256 y1 = _mm256_add_ps(_mm256_mul_ps(sin, fx), _mm256_mul_ps(cos, fy));
+			const __m256 x2 = _mm256_sub_ps(_mm256_mul_ps(cos, fx), _mm256_mul_ps(sin, fy2));
+			const __m256 y2 = _mm256_add_ps(_mm256_mul_ps(sin, fx), _mm256_mul_ps(cos, fy2));
+			const __m256 x3 = _mm256_sub_ps(_mm256_mul_ps(cos, fx2), _mm256_mul_ps(sin, fy2));
+			const __m256 y3 = _mm256_add_ps(_mm256_mul_ps(sin, fx2), _mm256_mul_ps(cos, fy2));
+
+			_mm256_store_ps(b.x[0] + i, _mm256_add_ps(x1, px));
+			_mm256_store_ps(b.y[0] + i, _mm256_add_ps(y1, py));
+			_mm256_store_ps(b.x[1] + i, _mm256_add_ps(x2, px));
+			_mm256_store_ps(b.y[1] + i, _mm256_add_ps(y2, py));
+			_mm256_store_ps(b.x[2] + i, _mm256_add_ps(x3, px));
+			_mm256_store_ps(b.y[2] + i, _mm256_add_ps(y3, py));
+			_mm256_store_ps(b.x[3] + i, _mm256_add_ps(_mm256_add_ps(x1, _mm256_sub_ps(x3, x2)), px));
+			_mm256_store_ps(b.y[3] + i, _mm256_add_ps(_mm256_sub_ps(y3, _mm256_sub_ps(y2, y1)), py));
+			_mm256_store_ps(b.cos + i, cos);
+			_mm256_store_ps(b.sin + i, sin);
+
+			__m256i color = unorm8x(_mm256_load_ps(b.r + i), 255.0f);
+			color = _mm256_or_si256(color, _mm256_slli_epi32(unorm8x(_mm256_load_ps(b.g + i), 255.0f), 8));
+			color = _mm256_or_si256(color, _mm256_slli_epi32(unorm8x(_mm256_load_ps(b.b + i), 255.0f), 16));
+			color = _mm256_or_si256(color, _mm256_slli_epi32(unorm8x(_mm256_load_ps(b.a + i), 255.0f), 24));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(b.color + i), color);
+
+			const __m256i tangent = _mm256_or_si256(half8(cos), _mm256_slli_epi32(half8(sin), 16));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(b.tangent + i), tangent);
+
+			const __m256i uv1 = _mm256_or_si256(unorm8x(_mm256_load_ps(b.u1 + i), 65535.0f), _mm256_slli_epi32(unorm8x(_mm256_load_ps(b.v1 + i), 65535.0f), 16));
+			const __m256i uv2 = _mm256_or_si256(unorm8x(_mm256_load_ps(b.u2 + i), 65535.0f), _mm256_slli_epi32(unorm8x(_mm256_load_ps(b.v2 + i), 65535.0f), 16));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(b.uv1 + i), uv1);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(b.uv2 + i), uv2);
+		}
+	}
+
+	static bool cpuHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_cpu_supports("avx2");
+#else
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		const bool avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27));
+		if (!avx || (_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(info, 7, 0);
+		return info[1] & (1 << 5);
+#endif
+	}
+#endif
+#endif
+
+	static BlockFunc blockKernel() {
+#ifdef GT_SPRITE_AVX2
+		if (cpuHasAVX2()) return blockAVX2;
+#endif
+#ifdef GT_SPRITE_SSE2
+		return blockSSE2;
+#else
+		return blockScalar;
+#endif
+	}
+
+	// Keys are generated in submission order and the sort is stable, so only
+	// the bits above the command index need to be sorted.
+	static void radixSort(std::vector<u64>& keys, std::vector<u64>& scratch, u32 from) {
+		const size_t n = keys.size();
+		if (n < 2) return;
+
+		scratch.resize(n);
+		u64* src = keys.data();
+		u64* dst = scratch.data();
+		for (u32 shift = from; shift < 64; shift += 8) {
+			size_t counts[256] = {};
+			for (size_t i = 0; i < n; i++) counts[(src[i] >> shift) & 0xFF]++;
+			if (counts[(src[0] >> shift) & 0xFF] == n) continue;
+
+			size_t sum = 0;
+			for (size_t& c : counts) {
+				const size_t t = c;
+				c = sum;
+				sum += t;
+			}
+			for (size_t i = 0; i < n; i++) dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];
+			std::swap(src, dst);
+		}
+		if (src != keys.data()) std::memcpy(keys.data(), src, n * sizeof(u64));
+	}
+
+	SpriteBatch::SpriteBatch(u32 width, u32 height, StreamMode streamMode, Layout layout, u32 capacity, Growth growth, u32 maxCapacity) {
+		if (streamMode == StreamPersistent && !Buffer::storageSupported()) {
+			LogW("Persistent buffer mapping is not supported. Falling back to buffered streaming.");
+			streamMode = StreamBuffered;
+		}
+		m_streamMode = streamMode;
+		m_layout = layout;
+		m_growth = growth;
+		m_maxCapacity = maxCapacity ? std::max(maxCapacity, capacity) : 0;
+
+		switch (m_layout) {
+			case LayoutInstanced: m_stride = sizeof(Instance); break;
+			case LayoutPackedQuads: m_stride = sizeof(PackedVertex) * 4; break;
+			default: m_stride = sizeof(Vertex) * 4; break;
+		}
 
-	SpriteBatch::SpriteBatch(u32 width, u32 height) {
-		VertexFormat fmt = VertexFormat(sizeof(Vertex))
-			.add(2, DataType::TypeFloat)
-			.add(2, DataType::TypeFloat)
-			.add(4, DataType::TypeFloat)
-			.add(3, DataType::TypeFloat);
-		m_vao = VertexArray().create().bind();
-		m_vbo = Buffer().create(Buffer::ArrayBuffer).bind();
-		fmt.enable();
-		m_ibo = Buffer().create(Buffer::ElementBuffer).bind();
-		m_vao.unbind();
+		switch (m_layout) {
+			case LayoutInstanced: m_format = InstanceAttributes.format(1); break;
+			case LayoutPackedQuads: m_format = PackedVertexAttributes.format(); break;
+			default: m_format = VertexAttributes.format(); break;
+		}
+
+		allocate(std::max(capacity, 1u));
+
+		// the index buffer binding lives in the vertex array
+		m_ibo = Buffer().create(Buffer::ElementBuffer);
+		bindVertexArray();
+
+		std::vector<u16> indices;
+		indices.reserve(IndexedSprites * 6);
+		for (u32 i = 0; i < IndexedSprites; i++) {
+			const u16 off = i * 4;
+			indices.insert(indices.end(), { u16(off + 0), u16(off + 1), u16(off + 2), u16(off + 0), u16(off + 2), u16(off + 3) });
+		}
+		m_ibo.bind().update(indices, Buffer::StaticDraw);
 
 		m_defaultShader = Shader().create()
-			.add(SBVertexShader, Shader::VertexShader)
-			.add(FS, Shader::FragmentShader)
+			.add(vertexShaderSource(), Shader::VertexShader)
+			.add(fragmentShader(false), Shader::FragmentShader)
+			.link();
+		m_defaultArrayShader = Shader().create()
+			.add(vertexShaderSource(), Shader::VertexShader)
+			.add(fragmentShader(true), Shader::FragmentShader)
 			.link();
 		m_currentShader = Shader(m_defaultShader.id());
 
+		GLint maxUnits = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+		m_maxTextureSlots = std::min(u32(maxUnits), TextureSlots);
+
 		m_projection = ortho(0, width, height, 0, -1, 1);
 		m_view = Matrix4();
+		m_resolution = Vector2(float(width), float(height));
+		m_frameConstants = Buffer().create(Buffer::UniformBuffer);
+		m_frameConstants.bind().streamPolicy(Buffer::PolicyOrphan);
 
-		m_vertices.reserve(SpritesCount * 4);
-		m_indices.reserve(SpritesCount * 6);
+		GLState& gl = GLState::get();
+		gl.depthTest(false);
+		gl.cullFace(false);
+		gl.frontFace(GL_CCW);
+	}
 
-		glDisable(GL_DEPTH_TEST);
-		glDisable(GL_CULL_FACE);
-		glFrontFace(GL_CCW);
+	void SpriteBatch::allocate(u32 capacity) {
+		m_capacity = capacity;
+		if (m_streamMode == StreamPersistent) {
+			// immutable storage can't be resized, start over with a new buffer
+			if (m_mapped) {
+				m_vbo.bind().unmap();
+				m_vbo.destroy();
+				m_mapped = nullptr;
+			}
+			for (GLsync& fence : m_fences) {
+				if (fence) glDeleteSync(fence);
+				fence = nullptr;
+			}
+			m_segment = 0;
+			if (m_recording) {
+				m_storage.resize(m_stride * m_capacity);
+			} else {
+				m_count = m_batchStart = 0;
+			}
+
+			const u32 size = m_stride * m_capacity * StreamSegments;
+			const u32 flags = Buffer::MapWrite | Buffer::MapPersistent | Buffer::MapCoherent;
+			m_vbo = Buffer().create(Buffer::ArrayBuffer).bind();
+			m_vbo.storage(size, flags);
+			m_mapped = m_vbo.mapRange<u8>(0, size, flags);
+		} else {
+			// each flush appends to a ring instead of waiting on the last draw
+			if (!m_vbo.id()) m_vbo = Buffer().create(Buffer::ArrayBuffer);
+			m_storage.resize(m_stride * m_capacity);
+			m_vbo.bind()
+				.streamPolicy(Buffer::PolicyRing, m_stride)
+				.reserve(m_stride * m_capacity * StreamSegments, Buffer::StreamDraw);
+		}
+	}
+
+	u32 SpriteBatch::room(u32 count) {
+		if (m_growth == GrowFixed && m_frameCount >= m_capacity) {
+			if (m_dropped == 0) LogW("Sprite batch is full, sprites will be dropped until the next frame.");
+			return 0;
+		}
+		if (m_count >= m_capacity) {
+			if (m_growth == GrowGeometric && (m_maxCapacity == 0 || m_capacity < m_maxCapacity)) {
+				const u32 capacity = m_maxCapacity ? std::min(m_capacity * 2, m_maxCapacity) : m_capacity * 2;
+				if (mapped()) flush(FlushCapacity);
+				allocate(capacity);
+			} else {
+				flush(FlushCapacity);
+				if (mapped()) nextSegment();
+			}
+		}
+		u32 room = std::min(count, m_capacity - m_count);
+		if (m_growth == GrowFixed) room = std::min(room, m_capacity - m_frameCount);
+		return room;
+	}
+
+	u8* SpriteBatch::cursor() {
+		return (mapped() ? m_mapped + m_segment * m_capacity * m_stride : m_storage.data()) + m_count * m_stride;
+	}
+
+	void SpriteBatch::bindVertexArray() {
+		VertexArrayCache::get().bind(m_format, m_vbo, m_ibo);
 	}
 
 	SpriteBatch::~SpriteBatch() {
+		for (GLsync& fence : m_fences) {
+			if (fence) glDeleteSync(fence);
+			fence = nullptr;
+		}
+		if (m_mapped) {
+			m_vbo.bind().unmap();
+			m_mapped = nullptr;
+		}
 		m_defaultShader.destroy();
+		m_defaultArrayShader.destroy();
 		m_vbo.destroy();
 		m_ibo.destroy();
-		m_vao.destroy();
+		m_frameConstants.destroy();
 	}
 
-	void SpriteBatch::begin() {
+	void SpriteBatch::begin(SortMode sortMode) {
 		if (m_drawing) return;
-		glDepthMask(false);
+		m_sortMode = sortMode;
+		GLState::get().depthMask(false);
 		m_currentShader.bind();
-		setupMatrices();
+		setupFrame();
+		setupShader();
+		m_accepted = m_culled = 0;
+		m_frameCount = m_dropped = 0;
+		m_stats = Stats{};
 		m_drawing = true;
 	}
 
 	void SpriteBatch::flush() {
-		if (m_vertices.empty()) return;
-		if (m_lastTexture.id()) m_lastTexture.bind(0);
+		flush(FlushExplicit);
+	}
+
+	void SpriteBatch::flush(FlushReason reason) {
+		if (m_sortMode != SortImmediate) emit(reason);
+		if (m_count == m_batchStart) return;
+
+		if (m_recording) {
+			SpriteCommandList::Batch batch;
+			batch.shader = m_currentShader;
+			batch.blend = blendState();
+			batch.depthTest = m_depthTest;
+			batch.depthWrite = m_depthWrite;
+			for (u32 i = 0; i < m_textureCount; i++) batch.textures[i] = m_textures[i];
+			batch.textureCount = m_textureCount;
+
+			m_recording->append(m_storage.data(), m_count, batch);
+			m_count = 0;
+			m_textureCount = 0;
+			return;
+		}
+
+		const u32 sprites = m_count - m_batchStart;
+		m_stats.sprites += sprites;
+		m_stats.vertices += sprites * 4;
+		m_stats.bytes += u64(sprites) * m_stride;
+		m_stats.flushes++;
+		m_stats.reasons[reason]++;
+		if (!m_trace.empty()) {
+			m_trace[m_traceNext] = { reason, sprites };
+			m_traceNext = (m_traceNext + 1) % m_trace.size();
+		}
+
+		for (u32 i = 0; i < m_textureCount; i++) {
+			if (m_textures[i].id()) m_textures[i].bind(i);
+		}
+
+		bindVertexArray();
+		u32 first = m_segment * m_capacity;
+		if (!m_mapped) {
+			m_vbo.bind().update(m_storage.data(), m_count * m_stride, Buffer::StreamDraw);
+			first = m_vbo.streamOffset() / m_stride;
+		}
 
-		m_vbo.bind().update(m_vertices, Buffer::DynamicDraw);
-		m_ibo.bind().update(m_indices, Buffer::DynamicDraw);
+		setupBlending();
 
-		if (!m_blending) {
-			glDisable(GL_BLEND);
+		if (m_layout == LayoutInstanced) {
+			const u32 baseInstance = first + m_batchStart;
+			glDrawElementsInstancedBaseInstance(
+				GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr,
+				m_count - m_batchStart, baseInstance
+			);
+			m_stats.draws++;
 		} else {
-			glEnable(GL_BLEND);
-			if (m_srcFuncColor != -1)
-				glBlendFuncSeparate(m_srcFuncColor, m_dstFuncColor, m_srcFuncAlpha, m_dstFuncAlpha);
+			// u16 indices address 16k sprites, larger batches are split
+			for (u32 i = m_batchStart; i < m_count; i += IndexedSprites) {
+				const u32 count = std::min(m_count - i, IndexedSprites);
+				const GLint baseVertex = (first + i) * 4;
+				glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, nullptr, baseVertex);
+				m_stats.draws++;
+			}
 		}
 
-		m_vao.bind();
-		glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_INT, nullptr);
-		m_vao.unbind();
+		if (m_mapped) {
+			m_batchStart = m_count;
+		} else {
+			m_count = 0;
+		}
+		m_textureCount = 0;
+	}
+
+	void SpriteBatch::traceFlushes(u32 size) {
+		m_trace.assign(size, FlushEvent{ FlushExplicit, 0 });
+		m_traceNext = 0;
+	}
+
+	std::vector<SpriteBatch::FlushEvent> SpriteBatch::flushEvents() const {
+		std::vector<FlushEvent> events;
+		events.reserve(m_trace.size());
+		for (size_t i = 0; i < m_trace.size(); i++) {
+			const FlushEvent& ev = m_trace[(m_traceNext + i) % m_trace.size()];
+			if (ev.sprites) events.push_back(ev);
+		}
+		return events;
+	}
+
+	void SpriteBatch::depthState(bool test, bool write) {
+		m_depthTest = test;
+		m_depthWrite = write;
+		GLState& gl = GLState::get();
+		gl.depthTest(test);
+		gl.depthMask(write);
+	}
 
-		m_vertices.clear();
-		m_indices.clear();
+	void SpriteBatch::setupBlending() {
+		GLState& gl = GLState::get();
+		gl.blend(m_blending);
+		if (m_blending && m_srcFuncColor != -1)
+			gl.blendFunc(m_srcFuncColor, m_dstFuncColor, m_srcFuncAlpha, m_dstFuncAlpha);
+	}
+
+	void SpriteBatch::draw(SpriteLayer& layer) {
+		if (!m_drawing || m_recording || layer.m_count == 0) return;
+		if (layer.m_layout != m_layout) {
+			LogE("Sprite layer layout doesn't match the batch layout.");
+			return;
+		}
+		flush(FlushLayer);
+
+		const Shader& sh = shaderFor(layer.m_texture);
+		if (sh.id() != m_currentShader.id()) shader(sh);
+
+		layer.m_texture.bind(0);
+		setupBlending();
+		m_stats.bytes += layer.upload();
+		m_stats.sprites += layer.count();
+		m_stats.vertices += layer.count() * 4;
+
+		// the layer shares the batch's u16 quad indices
+		VertexArrayCache::get().bind(layer.m_format, layer.m_vbo, m_ibo);
+		if (m_layout == LayoutInstanced) {
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr, layer.m_count);
+			m_stats.draws++;
+		} else {
+			for (u32 i = 0; i < layer.m_count; i += IndexedSprites) {
+				const u32 count = std::min(layer.m_count - i, IndexedSprites);
+				glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, nullptr, i * 4);
+				m_stats.draws++;
+			}
+		}
+	}
+
+	void SpriteBatch::draw(GpuSpriteLayer& layer) {
+		if (!m_drawing || m_recording || layer.count() == 0) return;
+		if (m_layout != LayoutInstanced) {
+			LogE("GPU sprite layers need an instanced sprite batch.");
+			return;
+		}
+		flush(FlushLayer);
+
+		m_stats.bytes += layer.cull(m_viewRect);
+		m_stats.sprites += layer.count();
+		m_stats.vertices += layer.count() * 4;
+		m_stats.draws += layer.m_buckets.size();
+		m_currentShader.bind();
+		setupBlending();
+
+		VertexArrayCache::get().bind(layer.m_format, layer.m_output, layer.m_ibo);
+		layer.m_commands.bind();
+		for (u32 i = 0; i < layer.m_buckets.size(); i++) {
+			Texture& texture = layer.m_buckets[i].texture;
+			const Shader& sh = shaderFor(texture);
+			if (sh.id() != m_currentShader.id()) shader(sh);
+
+			texture.bind(0);
+			glDrawElementsIndirect(
+				GL_TRIANGLES, GL_UNSIGNED_INT,
+				reinterpret_cast<void*>(i * sizeof(GpuSpriteLayer::Command))
+			);
+		}
+		layer.m_commands.unbind();
+	}
+
+	void SpriteBatch::nextSegment() {
+		m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_segment = (m_segment + 1) % StreamSegments;
+		m_count = m_batchStart = 0;
+
+		GLsync& fence = m_fences[m_segment];
+		if (fence) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
 	}
 
 	void SpriteBatch::end() {
 		if (!m_drawing) return;
-		if (!m_vertices.empty()) flush();
-		m_lastTexture = Texture();
+		if (m_sortMode != SortImmediate) {
+			emit(FlushEnd);
+			m_sortMode = SortImmediate;
+		}
+		stitch();
+		flush(FlushEnd);
+		if (m_mapped && m_count > 0) nextSegment();
+		if (m_recording) {
+			m_recording->upload();
+			m_recording = nullptr;
+		}
+		m_sortMode = SortImmediate;
+		m_textureCount = 0;
 		m_drawing = false;
-		glDepthMask(true);
+		GLState::get().depthMask(true);
 		m_currentShader.unbind();
 
 		if (m_blending) {
-			glDisable(GL_BLEND);
+			GLState::get().blend(false);
 		}
 	}
 
-	void SpriteBatch::setupMatrices() {
-		m_currentShader.get("uProjView").set(m_projection * m_view, true);
-		m_currentShader.get("uTexture").set(0);
+	void SpriteBatch::beginRecording(SpriteCommandList& list, SortMode sortMode) {
+		if (m_drawing) return;
+		list.clear();
+		list.m_layout = m_layout;
+		list.m_stride = m_stride;
+		begin(sortMode);
+		m_recording = &list;
+		m_storage.resize(m_stride * m_capacity);
+	}
+
+	void SpriteBatch::draw(SpriteCommandList& list) {
+		if (!m_drawing || m_recording || list.empty()) return;
+		if (list.m_layout != m_layout) {
+			LogE("Sprite command list layout doesn't match the batch layout.");
+			return;
+		}
+		flush(FlushLayer);
+		replay(list);
+	}
+
+	void SpriteBatch::draw(SpriteCommandList& list, const Matrix4& transform) {
+		if (!m_drawing || m_recording || list.empty()) return;
+		const Matrix4 view = m_view;
+		viewMatrix(view * transform);
+		draw(list);
+		viewMatrix(view);
+	}
+
+	void SpriteBatch::replay(SpriteCommandList& list) {
+		const Shader current = m_currentShader;
+		const BlendState blend = blendState();
+		const SortMode mode = m_sortMode;
+
+		// nothing is pending, so the state changes below don't flush
+		m_sortMode = SortImmediate;
+		VertexArrayCache::get().bind(m_format, list.m_vbo, m_ibo);
+		for (SpriteCommandList::Batch& batch : list.m_batches) {
+			if (batch.shader.id() != m_currentShader.id()) shader(batch.shader);
+			blendState(batch.blend);
+			setupBlending();
+			if (batch.depthTest) GLState::get().depthFunc(GL_LEQUAL);
+			depthState(batch.depthTest, batch.depthWrite);
+			for (u32 i = 0; i < batch.textureCount; i++) {
+				if (batch.textures[i].id()) batch.textures[i].bind(i);
+			}
+
+			if (m_layout == LayoutInstanced) {
+				glDrawElementsInstancedBaseInstance(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr, batch.count, batch.first);
+				m_stats.draws++;
+			} else {
+				for (u32 i = 0; i < batch.count; i += IndexedSprites) {
+					const u32 count = std::min(batch.count - i, IndexedSprites);
+					glDrawElementsBaseVertex(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, nullptr, (batch.first + i) * 4);
+					m_stats.draws++;
+				}
+			}
+		}
+		m_stats.sprites += list.m_count;
+		m_stats.vertices += list.m_count * 4;
+
+		depthState(false, false);
+		if (current.id() != m_currentShader.id()) shader(current);
+		blendState(blend);
+		m_sortMode = mode;
+	}
+
+	const std::string& SpriteBatch::vertexShaderSource() const {
+		return m_layout == LayoutInstanced ? SBInstancedVertexShader : SBVertexShader;
+	}
+
+	void SpriteBatch::setupFrame() {
+		m_projView = m_projection * m_view;
+
+		const Matrix4 inv = inverse(m_projView);
+		Vector2 lo(INFINITY), hi(-INFINITY);
+		for (float ny : { -1.0f, 1.0f }) {
+			for (float nx : { -1.0f, 1.0f }) {
+				const Vector4 p = inv * Vector4(nx, ny, 0.0f, 1.0f);
+				lo = Vector2(std::min(lo.x, p.x / p.w), std::min(lo.y, p.y / p.w));
+				hi = Vector2(std::max(hi.x, p.x / p.w), std::max(hi.y, p.y / p.w));
+			}
+		}
+		m_viewRect = Vector4(lo.x, lo.y, hi.x, hi.y);
+
+		FrameConstants constants;
+		constants.projection = m_projection;
+		constants.view = m_view;
+		constants.projView = m_projView;
+		constants.resolution = m_resolution;
+		constants.time = m_time;
+		constants.padding = 0.0f;
+		m_frameConstants.bind()
+			.update(&constants, 1, Buffer::DynamicDraw)
+			.bindBase(FrameConstantsBinding);
+	}
+
+	void SpriteBatch::setupShader() {
+		const u32 generation = GLState::get().programGeneration();
+		if (generation != m_programGeneration) {
+			m_shaders.clear();
+			m_programGeneration = generation;
+		}
+
+		auto info = m_shaders.find(m_currentShader.id());
+		if (info == m_shaders.end()) {
+			// sampler units and block bindings are program state, set them once
+			const i32 block = m_currentShader.getBlockIndex(Shader::UniformBufferBlock, "FrameConstants");
+			if (block >= 0) m_currentShader.uniformBlockBinding(block, FrameConstantsBinding);
+			m_currentShader.get("uTexture").set(0);
+
+			const u32 size = std::max(m_currentShader.getUniformSize("uTextures"), 1);
+			const u32 slots = std::min(size, m_maxTextureSlots);
+			if (slots > 1) {
+				i32 units[TextureSlots];
+				for (u32 i = 0; i < slots; i++) units[i] = i;
+				m_currentShader.get("uTextures").set(units, slots);
+			}
+			info = m_shaders.emplace(m_currentShader.id(), ShaderInfo{ slots, m_currentShader.getUniformIndex("uProjView") }).first;
+		}
+		m_textureSlots = info->second.slots;
+
+		if (info->second.projView >= 0) {
+			Shader::Uniform projView{ u32(info->second.projView) };
+			projView.set(m_projView, true);
+		}
 	}
 
 	void SpriteBatch::projectionMatrix(const Matrix4& v) {
-		if (m_drawing) flush();
+		if (m_drawing) flush(FlushMatrix);
 		m_projection = v;
-		if (m_drawing) setupMatrices();
+		if (m_drawing) {
+			setupFrame();
+			setupShader();
+		}
 	}
 
 	void SpriteBatch::viewMatrix(const Matrix4& v) {
-		if (m_drawing) flush();
+		if (m_drawing) flush(FlushMatrix);
 		m_view = v;
-		if (m_drawing) setupMatrices();
+		if (m_drawing) {
+			setupFrame();
+			setupShader();
+		}
 	}
 
 	void SpriteBatch::shader(const Shader& s) {
 		if (m_drawing) {
-			flush();
+			if (m_sortMode == SortImmediate) flush(FlushShader);
 			m_currentShader.unbind();
 		}
 		m_currentShader = s.id() != 0 ? s : m_defaultShader;
 		if (m_drawing) {
 			m_currentShader.bind();
-			setupMatrices();
+			setupShader();
+		}
+	}
+
+	u32 SpriteBatch::textureSlot(const Texture& tex) {
+		if (m_textureCount > 0 && m_textures[m_lastSlot].id() == tex.id()) return m_lastSlot;
+		for (u32 i = 0; i < m_textureCount; i++) {
+			if (m_textures[i].id() == tex.id()) return m_lastSlot = i;
 		}
+		if (m_textureCount >= m_textureSlots) flush(FlushTexture);
+		m_textures[m_textureCount] = tex;
+		return m_lastSlot = m_textureCount++;
 	}
 
-	void SpriteBatch::switchTexture(const Texture& tex) {
-		flush();
-		m_lastTexture = tex;
+	const Shader& SpriteBatch::shaderFor(const Texture& texture) const {
+		const bool array = texture.type() == TextureType::Texture2DArray;
+		if (m_currentShader.id() == m_defaultShader.id() && array) return m_defaultArrayShader;
+		if (m_currentShader.id() == m_defaultArrayShader.id() && !array) return m_defaultShader;
+		return m_currentShader;
 	}
 
 	void SpriteBatch::draw(const Texture& texture, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		draw(texture, 0, position, rotation, origin, scale, uv);
+	}
+
+	bool SpriteBatch::visible(const Vector2& position, float rotation, float fx, float fy, float fx2, float fy2) const {
+		const float minX = m_viewRect.x, minY = m_viewRect.y;
+		const float maxX = m_viewRect.z, maxY = m_viewRect.w;
+
+		// bounding circle around the pivot first, it needs no trigonometry
+		const float rx = std::max(std::abs(fx), std::abs(fx2));
+		const float ry = std::max(std::abs(fy), std::abs(fy2));
+		const float r = std::sqrt(rx * rx + ry * ry);
+		if (position.x + r < minX || position.x - r > maxX || position.y + r < minY || position.y - r > maxY) return false;
+		if (position.x - r >= minX && position.x + r <= maxX && position.y - r >= minY && position.y + r <= maxY) return true;
+
+		// straddling the edge, test the bounds of the rotated rectangle
+		const float cos = std::cos(rotation);
+		const float sin = std::sin(rotation);
+		const float ox = (fx + fx2) * 0.5f, oy = (fy + fy2) * 0.5f;
+		const float hw = std::abs(fx2 - fx) * 0.5f, hh = std::abs(fy2 - fy) * 0.5f;
+		const float cx = position.x + cos * ox - sin * oy;
+		const float cy = position.y + sin * ox + cos * oy;
+		const float ex = std::abs(cos) * hw + std::abs(sin) * hh;
+		const float ey = std::abs(sin) * hw + std::abs(cos) * hh;
+		return !(cx + ex < minX || cx - ex > maxX || cy + ey < minY || cy - ey > maxY);
+	}
+
+	void SpriteBatch::draw(const Texture& textureArray, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		Sprite sprite;
+		sprite.position = position;
+		sprite.rotation = rotation;
+		sprite.origin = origin;
+		sprite.scale = scale;
+		sprite.uv = uv;
+		sprite.color = m_color;
+		sprite.layer = arrayLayer;
+		sprite.depth = m_depth;
+		queue(textureArray, sprite);
+	}
+
+	void SpriteBatch::draw(const Texture& texture, const SpriteMesh& mesh, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		if (mesh.empty()) return;
+
+		Sprite sprite;
+		sprite.position = position;
+		sprite.rotation = rotation;
+		sprite.origin = origin;
+		sprite.scale = scale;
+		sprite.uv = uv;
+		sprite.color = m_color;
+		sprite.layer = 0;
+		sprite.depth = m_depth;
+		// instances are always quads
+		if (m_layout != LayoutInstanced) sprite.mesh = &mesh;
+		queue(texture, sprite);
+	}
+
+	void SpriteBatch::queue(const Texture& texture, const Sprite& sprite) {
+		if (m_culling && m_drawing && !m_recording) {
+			const float tw = texture.width() * sprite.uv.z;
+			const float th = texture.height() * sprite.uv.w;
+			const float ox = sprite.origin.x * tw;
+			const float oy = sprite.origin.y * th;
+			const Vector2& scale = sprite.scale;
+			if (!visible(sprite.position, sprite.rotation, -ox * scale.x, -oy * scale.y, (tw - ox) * scale.x, (th - oy) * scale.y)) {
+				m_culled++;
+				return;
+			}
+			m_accepted++;
+		}
+
+		if (m_drawing && m_sortMode != SortImmediate) {
+			record(texture, sprite);
+		} else {
+			submit(texture, sprite);
+		}
+	}
+
+	void SpriteBatch::drawMany(const Texture& texture, const SpriteArrays& sprites) {
+		static const BlockFunc kernel = blockKernel();
+
+		const float texWidth = texture.width();
+		const float texHeight = texture.height();
+
+		// missing arrays read a single default value with a zero stride
+		const float zeroRotation = 0.0f;
+		const Vector2 zeroOrigin(0.0f), unitScale(1.0f);
+		const Vector4 fullUV(0, 0, 1, 1);
+		const float* rotations = sprites.rotations ? sprites.rotations : &zeroRotation;
+		const Vector2* origins = sprites.origins ? sprites.origins : &zeroOrigin;
+		const Vector2* scales = sprites.scales ? sprites.scales : &unitScale;
+		const Vector4* uvs = sprites.uvs ? sprites.uvs : &fullUV;
+		const Vector4* colors = sprites.colors ? sprites.colors : &m_color;
+		const float* depths = sprites.depths ? sprites.depths : &m_depth;
+		const u32 rotationStep = sprites.rotations ? 1 : 0;
+		const u32 originStep = sprites.origins ? 1 : 0;
+		const u32 scaleStep = sprites.scales ? 1 : 0;
+		const u32 uvStep = sprites.uvs ? 1 : 0;
+		const u32 colorStep = sprites.colors ? 1 : 0;
+		const u32 depthStep = sprites.depths ? 1 : 0;
+
+		const bool culling = m_culling && m_drawing && !m_recording;
+		auto culled = [&](u32 index, float fx, float fy, float fx2, float fy2) {
+			if (!culling) return false;
+			if (visible(sprites.positions[index], rotations[index * rotationStep], fx, fy, fx2, fy2)) {
+				m_accepted++;
+				return false;
+			}
+			m_culled++;
+			return true;
+		};
+
+		// instanced batches draw meshes as quads, so only other layouts split
+		if (sprites.meshes && m_layout != LayoutInstanced) {
+			// runs of quads keep the SIMD path, meshes go through queue() in order
+			auto run = [&](u32 begin, u32 end) {
+				if (begin == end) return;
+				SpriteArrays quads;
+				quads.count = end - begin;
+				quads.positions = sprites.positions + begin;
+				quads.rotations = sprites.rotations ? sprites.rotations + begin : nullptr;
+				quads.origins = sprites.origins ? sprites.origins + begin : nullptr;
+				quads.scales = sprites.scales ? sprites.scales + begin : nullptr;
+				quads.uvs = sprites.uvs ? sprites.uvs + begin : nullptr;
+				quads.colors = sprites.colors ? sprites.colors + begin : nullptr;
+				quads.depths = sprites.depths ? sprites.depths + begin : nullptr;
+				drawMany(texture, quads);
+			};
+
+			u32 begin = 0;
+			for (u32 i = 0; i < sprites.count; i++) {
+				const SpriteMesh* mesh = sprites.meshes[i];
+				if (!mesh) continue;
+				run(begin, i);
+				begin = i + 1;
+				if (mesh->empty()) continue;
+
+				Sprite sp;
+				sp.position = sprites.positions[i];
+				sp.rotation = rotations[i * rotationStep];
+				sp.origin = origins[i * originStep];
+				sp.scale = scales[i * scaleStep];
+				sp.uv = uvs[i * uvStep];
+				sp.color = colors[i * colorStep];
+				sp.layer = 0;
+				sp.depth = depths[i * depthStep];
+				sp.mesh = mesh;
+				queue(texture, sp);
+			}
+			run(begin, sprites.count);
+			return;
+		}
+
+		if (m_drawing && m_sortMode != SortImmediate) {
+			for (u32 i = 0; i < sprites.count; i++) {
+				const Vector2& origin = origins[i * originStep];
+				const Vector2& scale = scales[i * scaleStep];
+				const Vector4& uv = uvs[i * uvStep];
+				const float tw = texWidth * uv.z;
+				const float th = texHeight * uv.w;
+				const float ox = origin.x * tw;
+				const float oy = origin.y * th;
+				if (culled(i, -ox * scale.x, -oy * scale.y, (tw - ox) * scale.x, (th - oy) * scale.y)) continue;
+
+				Sprite sp;
+				sp.position = sprites.positions[i];
+				sp.rotation = rotations[i * rotationStep];
+				sp.origin = origin;
+				sp.scale = scale;
+				sp.uv = uv;
+				sp.color = colors[i * colorStep];
+				sp.layer = 0;
+				sp.depth = depths[i * depthStep];
+				record(texture, sp);
+			}
+			return;
+		}
+
 		if (!m_drawing) flush();
 
-		if (m_lastTexture.id() != texture.id()) {
-			switchTexture(texture);
-		} else if (m_vertices.size() / 4 >= SpritesCount) {
-			flush();
+		const Shader& sh = shaderFor(texture);
+		if (sh.id() != m_currentShader.id()) shader(sh);
+
+		SpriteBlock block;
+		u32 next = 0;
+		while (next < sprites.count) {
+			const u32 capacity = room(SpriteBlock::Size);
+			if (capacity == 0) {
+				m_dropped += sprites.count - next;
+				break;
+			}
+			const u32 slot = textureSlot(texture);
+
+			u8* dst = cursor();
+			u32 count = 0;
+			if (m_layout == LayoutInstanced) {
+				for (; next < sprites.count && count < capacity; next++) {
+					const Vector2& origin = origins[next * originStep];
+					const Vector2& scale = scales[next * scaleStep];
+					const Vector4& uv = uvs[next * uvStep];
+					const float tw = texWidth * uv.z;
+					const float th = texHeight * uv.w;
+					if (culled(next, -origin.x * tw * scale.x, -origin.y * th * scale.y, (tw - origin.x * tw) * scale.x, (th - origin.y * th) * scale.y)) continue;
+
+					writeInstance(
+						dst + count * m_stride,
+						sprites.positions[next],
+						Vector2(tw * scale.x, th * scale.y),
+						origin, rotations[next * rotationStep],
+						uv, colors[next * colorStep],
+						slot, 0, depths[next * depthStep]
+					);
+					count++;
+				}
+				m_count += count;
+				m_frameCount += count;
+				continue;
+			}
+
+			for (; next < sprites.count && count < capacity; next++) {
+				const Vector2& position = sprites.positions[next];
+				const Vector2& origin = origins[next * originStep];
+				const Vector2& scale = scales[next * scaleStep];
+				const Vector4& uv = uvs[next * uvStep];
+				const Vector4& color = colors[next * colorStep];
+				const float tw = texWidth * uv.z;
+				const float th = texHeight * uv.w;
+				const float ox = origin.x * tw;
+				const float oy = origin.y * th;
+				const float fx = -ox * scale.x;
+				const float fy = -oy * scale.y;
+				const float fx2 = (tw - ox) * scale.x;
+				const float fy2 = (th - oy) * scale.y;
+				if (culled(next, fx, fy, fx2, fy2)) continue;
+
+				const u32 i = count++;
+				block.rotation[i] = rotations[next * rotationStep];
+				block.px[i] = position.x;
+				block.py[i] = position.y;
+				block.fx[i] = fx;
+				block.fy[i] = fy;
+				block.fx2[i] = fx2;
+				block.fy2[i] = fy2;
+				block.u1[i] = uv.x;
+				block.v1[i] = uv.y;
+				block.u2[i] = uv.x + uv.z;
+				block.v2[i] = uv.y + uv.w;
+				block.r[i] = color.x;
+				block.g[i] = color.y;
+				block.b[i] = color.z;
+				block.a[i] = color.w;
+				block.z[i] = depths[next * depthStep];
+			}
+
+			// kernels work on whole vectors, pad the tail with zeroed sprites
+			const u32 padded = (count + 7) & ~7u;
+			for (u32 i = count; i < padded; i++) {
+				block.rotation[i] = block.px[i] = block.py[i] = 0.0f;
+				block.fx[i] = block.fy[i] = block.fx2[i] = block.fy2[i] = 0.0f;
+				block.u1[i] = block.v1[i] = block.u2[i] = block.v2[i] = 0.0f;
+				block.r[i] = block.g[i] = block.b[i] = block.a[i] = 0.0f;
+				block.z[i] = 0.0f;
+			}
+			kernel(block, padded);
+
+			if (m_layout == LayoutPackedQuads) {
+				// each vertex is written as six 32 bit words
+				u32* v = reinterpret_cast<u32*>(dst);
+				for (u32 i = 0; i < count; i++, v += 24) {
+					const u32 uv1 = block.uv1[i], uv2 = block.uv2[i];
+					const u32 us[4] = { uv1, (uv1 & 0xFFFF) | (uv2 & 0xFFFF0000), uv2, (uv2 & 0xFFFF) | (uv1 & 0xFFFF0000) };
+					// slot, layer 0 and depth share the last word
+					const u32 last = slot | (u32(half(block.z[i])) << 16);
+					for (u32 k = 0; k < 4; k++) {
+						u32* w = v + k * 6;
+						std::memcpy(w + 0, &block.x[k][i], sizeof(u32));
+						std::memcpy(w + 1, &block.y[k][i], sizeof(u32));
+						w[2] = us[k];
+						w[3] = block.color[i];
+						w[4] = block.tangent[i];
+						w[5] = last;
+					}
+				}
+			} else {
+				Vertex* v = reinterpret_cast<Vertex*>(dst);
+				for (u32 i = 0; i < count; i++, v += 4) {
+					const float us[4] = { block.u1[i], block.u1[i], block.u2[i], block.u2[i] };
+					const float vs[4] = { block.v1[i], block.v2[i], block.v2[i], block.v1[i] };
+					const Vector4 color(block.r[i], block.g[i], block.b[i], block.a[i]);
+					const u16 z = half(block.z[i]);
+					for (u32 k = 0; k < 4; k++) {
+						v[k].position.x = block.x[k][i];
+						v[k].position.y = block.y[k][i];
+						v[k].texCoord.x = us[k];
+						v[k].texCoord.y = vs[k];
+						v[k].color = color;
+						v[k].tangent.x = block.cos[i];
+						v[k].tangent.y = block.sin[i];
+						v[k].tangent.z = 0.0f;
+						v[k].slot = slot;
+						v[k].layer = 0;
+						v[k].depth = z;
+					}
+				}
+			}
+
+			m_count += count;
+			m_frameCount += count;
+		}
+	}
+
+	void SpriteBatch::record(const Texture& texture, const Sprite& sprite) {
+		const bool depthSorted = m_sortMode == SortDepth;
+		const bool opaque = depthSorted && m_opaque;
+
+		BlendState blend = blendState();
+		if (opaque) blend.enabled = false;
+		const Shader& sh = shaderFor(texture);
+
+		u32 shaderIndex = 0;
+		while (shaderIndex < m_sortShaders.size() && m_sortShaders[shaderIndex].id() != sh.id()) shaderIndex++;
+
+		u32 blendIndex = 0;
+		while (blendIndex < m_sortBlends.size() && std::memcmp(&m_sortBlends[blendIndex], &blend, sizeof(BlendState)) != 0) blendIndex++;
+
+		auto tex = m_sortTextureIndices.find(texture.id());
+		const u32 textureIndex = tex != m_sortTextureIndices.end() ? tex->second : m_sortTextures.size();
+
+		// key fields are 6/6/12 bits wide, emit what we have when a table overflows
+		const u64 maxCommands = depthSorted ? (u64(1) << 24) : (u64(1) << 32);
+		if (shaderIndex >= 64 || blendIndex >= 64 || textureIndex >= 4096 || m_commands.size() >= maxCommands) {
+			emit(FlushCapacity);
+			record(texture, sprite);
+			return;
+		}
+
+		if (shaderIndex == m_sortShaders.size()) m_sortShaders.push_back(sh);
+		if (blendIndex == m_sortBlends.size()) m_sortBlends.push_back(blend);
+		if (textureIndex == m_sortTextures.size()) {
+			m_sortTextures.push_back(texture);
+			m_sortTextureIndices[texture.id()] = textureIndex;
+		}
+
+		const u64 state = (u64(shaderIndex) << 18) | (u64(blendIndex) << 12) | u64(textureIndex);
+
+		u64 key;
+		if (depthSorted) {
+			u32 bits;
+			std::memcpy(&bits, &sprite.depth, sizeof(bits));
+			bits ^= (bits & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+			if (opaque) {
+				// nearest first. The top 15 bits of the order preserving float
+				// are enough to group by state, the depth test settles the rest.
+				const u64 depth = 0x7FFF - (bits >> 17);
+				key = (depth << 48) | (state << 24) | u64(m_commands.size());
+			} else {
+				// farthest first. Nothing settles blending order later, so the
+				// full depth takes the state bits and ties keep submission order.
+				key = (u64(1) << 63) | (u64(bits) << 24) | u64(m_commands.size());
+			}
+		} else {
+			key = (u64(m_layer) << 56) | (state << 32) | u64(m_commands.size());
+		}
+		m_keys.push_back(key);
+		m_commands.push_back(sprite);
+		m_commandStates.push_back(u32(state));
+	}
+
+	void SpriteBatch::emit(FlushReason reason) {
+		if (m_commands.empty()) return;
+
+		const SortMode mode = m_sortMode;
+		const bool depthSorted = mode == SortDepth;
+		const u32 stateShift = depthSorted ? 24 : 32;
+		const u64 indexMask = (u64(1) << stateShift) - 1;
+		radixSort(m_keys, m_sortScratch, stateShift);
+
+		const Shader current = m_currentShader;
+		const BlendState blend = blendState();
+
+		bool translucent = false;
+		if (depthSorted) {
+			GLState::get().depthFunc(GL_LEQUAL);
+			depthState(true, true);
+		}
+
+		m_sortMode = SortImmediate;
+		for (u64 key : m_keys) {
+			if (depthSorted && !translucent && (key >> 63)) {
+				flush(FlushPass);
+				depthState(true, false);
+				translucent = true;
+			}
+			const u32 index = u32(key & indexMask);
+			const u32 state = m_commandStates[index];
+			const Shader& sh = m_sortShaders[(state >> 18) & 0x3F];
+			if (sh.id() != m_currentShader.id()) shader(sh);
+			blendState(m_sortBlends[(state >> 12) & 0x3F]);
+			submit(m_sortTextures[state & 0xFFF], m_commands[index]);
+		}
+		flush(reason);
+
+		if (depthSorted) depthState(false, false);
+
+		if (current.id() != m_currentShader.id()) shader(current);
+		blendState(blend);
+		m_sortMode = mode;
+
+		m_commands.clear();
+		m_commandStates.clear();
+		m_keys.clear();
+		m_sortShaders.clear();
+		m_sortBlends.clear();
+		m_sortTextures.clear();
+		m_sortTextureIndices.clear();
+	}
+
+	void SpriteBatch::submit(const Texture& texture, const Sprite& sprite) {
+		if (!m_drawing) flush();
+
+		const Shader& sh = shaderFor(texture);
+		if (sh.id() != m_currentShader.id()) shader(sh);
+
+		// meshes take several quads that have to stay together
+		const u32 quads = sprite.mesh ? sprite.mesh->quadCount() : 1;
+		u32 count = room(quads);
+		if (count != 0 && count < quads) {
+			flush(FlushCapacity);
+			if (mapped()) nextSegment();
+			count = room(quads);
+		}
+		if (count < quads) {
+			m_dropped++;
+			return;
+		}
+		const u32 slot = textureSlot(texture);
+
+		writeSprite(cursor(), m_layout, texture, sprite, slot);
+		m_count += quads;
+		m_frameCount += quads;
+	}
+
+	void SpriteBatch::stitch() {
+		for (Recorder& rec : m_recorders) {
+			for (const Recorder::Run& run : rec.m_runs) {
+				const Shader& sh = shaderFor(run.texture);
+				if (sh.id() != m_currentShader.id()) shader(sh);
+
+				u32 done = 0;
+				while (done < run.count) {
+					const u32 count = room(run.count - done);
+					if (count == 0) {
+						m_dropped += run.count - done;
+						break;
+					}
+					const u32 slot = textureSlot(run.texture);
+
+					u8* dst = cursor();
+					std::memcpy(dst, rec.m_data.data() + (run.first + done) * m_stride, count * m_stride);
+					if (slot != 0) patchSlots(dst, count, slot);
+
+					m_count += count;
+					m_frameCount += count;
+					done += count;
+				}
+			}
+			rec.clear();
+		}
+	}
+
+	void SpriteBatch::patchSlots(u8* dst, u32 count, u32 slot) const {
+		if (m_layout == LayoutInstanced) {
+			Instance* inst = reinterpret_cast<Instance*>(dst);
+			for (u32 i = 0; i < count; i++) inst[i].slot = slot;
+		} else if (m_layout == LayoutPackedQuads) {
+			PackedVertex* v = reinterpret_cast<PackedVertex*>(dst);
+			for (u32 i = 0; i < count * 4; i++) v[i].slot = slot;
+		} else {
+			Vertex* v = reinterpret_cast<Vertex*>(dst);
+			for (u32 i = 0; i < count * 4; i++) v[i].slot = slot;
+		}
+	}
+
+	void SpriteBatch::openRecorders(u32 count) {
+		m_recorders.resize(count);
+		for (Recorder& rec : m_recorders) {
+			rec.m_layout = m_layout;
+			rec.m_stride = m_stride;
+		}
+	}
+
+	void SpriteBatch::Recorder::reserve(u32 sprites) {
+		m_data.reserve(sprites * m_stride);
+	}
+
+	void SpriteBatch::Recorder::draw(const Texture& texture, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		draw(texture, 0, position, rotation, origin, scale, uv);
+	}
+
+	void SpriteBatch::Recorder::draw(const Texture& textureArray, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		Sprite sprite;
+		sprite.position = position;
+		sprite.rotation = rotation;
+		sprite.origin = origin;
+		sprite.scale = scale;
+		sprite.uv = uv;
+		sprite.color = m_color;
+		sprite.layer = arrayLayer;
+		sprite.depth = m_depth;
+
+		if (m_runs.empty() || m_runs.back().texture.id() != textureArray.id()) {
+			m_runs.push_back({ textureArray, m_count, 0 });
+		}
+		m_runs.back().count++;
+
+		m_data.resize((m_count + 1) * m_stride);
+		writeSprite(m_data.data() + m_count * m_stride, m_layout, textureArray, sprite, 0);
+		m_count++;
+	}
+
+	void SpriteBatch::Recorder::clear() {
+		m_data.clear();
+		m_runs.clear();
+		m_count = 0;
+	}
+
+	void SpriteBatch::writeSprite(u8* dst, Layout layout, const Texture& texture, const Sprite& sprite, u32 slot) {
+		const Vector2& position = sprite.position;
+		const Vector2& origin = sprite.origin;
+		const Vector2& scale = sprite.scale;
+		const Vector4& uv = sprite.uv;
+		const Vector4& color = sprite.color;
+		const float rotation = sprite.rotation;
+
+		const float tw = texture.width() * uv.z;
+		const float th = texture.height() * uv.w;
+
+		if (layout == LayoutInstanced) {
+			writeInstance(dst, position, Vector2(tw * scale.x, th * scale.y), origin, rotation, uv, color, slot, sprite.layer, sprite.depth);
+			return;
+		}
+		if (sprite.mesh) {
+			writeMesh(dst, layout, texture, sprite, slot);
+			return;
 		}
 
-		const float tw = m_lastTexture.width() * uv.z;
-		const float th = m_lastTexture.height() * uv.w;
 		const float ox = origin.x * tw;
 		const float oy = origin.y * th;
 		const float wx = position.x;
@@ -166,8 +1476,6 @@ void main() {
 		const float p2y = fy2;
 		const float p3x = fx2;
 		const float p3y = fy2;
-		const float p4x = fx2;
-		const float p4y = fy;
 
 		float x1;
 		float y1;
@@ -194,34 +1502,129 @@ void main() {
 		x4 = x1 + (x3 - x2);
 		y4 = y3 - (y2 - y1);
 
-		x1 += wx;
-		y1 += wy;
-		x2 += wx;
-		y2 += wy;
-		x3 += wx;
-		y3 += wy;
-		x4 += wx;
-		y4 += wy;
+		const float xs[4] = { x1 + wx, x2 + wx, x3 + wx, x4 + wx };
+		const float ys[4] = { y1 + wy, y2 + wy, y3 + wy, y4 + wy };
+		writeQuad(dst, layout, xs, ys, cos, sin, uv, color, slot, sprite.layer, sprite.depth);
+	}
 
-		float u1 = uv.x;
-		float v1 = uv.y;
-		float u2 = uv.x + uv.z;
-		float v2 = uv.y + uv.w;
+	void SpriteBatch::writeInstance(
+		u8* dst,
+		const Vector2& position, const Vector2& size, const Vector2& origin, float rotation,
+		const Vector4& uv, const Vector4& color, u32 slot, u32 layer, float depth
+	) {
+		Instance* inst = reinterpret_cast<Instance*>(dst);
+		inst->position = position;
+		inst->size = size;
+		inst->origin = origin;
+		inst->rotation = rotation;
+		inst->color[0] = unorm8(color.x);
+		inst->color[1] = unorm8(color.y);
+		inst->color[2] = unorm8(color.z);
+		inst->color[3] = unorm8(color.w);
+		inst->uv = uv;
+		inst->slot = slot;
+		inst->layer = layer;
+		inst->depth = depth;
+	}
 
-		u32 off = m_vertices.size();
+	void SpriteBatch::writeQuad(
+		u8* dst, Layout layout,
+		const float* xs, const float* ys, float cos, float sin,
+		const Vector4& uv, const Vector4& color, u32 slot, u32 layer, float depth
+	) {
+		const float u1 = uv.x;
+		const float v1 = uv.y;
+		const float u2 = uv.x + uv.z;
+		const float v2 = uv.y + uv.w;
+
+		const float us[4] = { u1, u1, u2, u2 };
+		const float vs[4] = { v1, v2, v2, v1 };
+		writeVertices(dst, layout, xs, ys, us, vs, cos, sin, color, slot, layer, depth);
+	}
+
+	void SpriteBatch::writeVertices(
+		u8* dst, Layout layout,
+		const float* xs, const float* ys, const float* us, const float* vs, float cos, float sin,
+		const Vector4& color, u32 slot, u32 layer, float depth
+	) {
+		if (layout == LayoutPackedQuads) {
+			const u8 col[4] = { unorm8(color.x), unorm8(color.y), unorm8(color.z), unorm8(color.w) };
+			const u16 tan[2] = { half(cos), half(sin) };
+			const u16 z = half(depth);
+
+			PackedVertex* v = reinterpret_cast<PackedVertex*>(dst);
+			for (u32 i = 0; i < 4; i++) {
+				v[i].position = Vector2(xs[i], ys[i]);
+				v[i].texCoord[0] = unorm16(us[i]);
+				v[i].texCoord[1] = unorm16(vs[i]);
+				std::memcpy(v[i].color, col, sizeof(col));
+				std::memcpy(v[i].tangent, tan, sizeof(tan));
+				v[i].slot = slot;
+				v[i].layer = layer;
+				v[i].depth = z;
+			}
+			return;
+		}
 
 		const Vector3 tangent(cos, sin, 0.0f);
+		const u16 z = half(depth);
+
+		Vertex* v = reinterpret_cast<Vertex*>(dst);
+		for (u32 i = 0; i < 4; i++) {
+			v[i] = Vertex(Vector2(xs[i], ys[i]), Vector2(us[i], vs[i]), color, tangent, slot, layer, z);
+		}
+	}
+
+	void SpriteBatch::writeMesh(u8* dst, Layout layout, const Texture& texture, const Sprite& sprite, u32 slot) {
+		const SpriteMesh& mesh = *sprite.mesh;
+		const std::vector<Vector2>& points = mesh.points();
+		const Vector4& uv = sprite.uv;
+		const float tw = texture.width() * uv.z;
+		const float th = texture.height() * uv.w;
+		const float cos = std::cos(sprite.rotation);
+		const float sin = std::sin(sprite.rotation);
+
+		auto corner = [&](u32 i, float& x, float& y, float& u, float& v) {
+			const Vector2& p = points[std::min(i, u32(points.size() - 1))];
+			const float lx = (p.x - sprite.origin.x) * tw * sprite.scale.x;
+			const float ly = (p.y - sprite.origin.y) * th * sprite.scale.y;
+			x = cos * lx - sin * ly + sprite.position.x;
+			y = sin * lx + cos * ly + sprite.position.y;
+			u = uv.x + p.x * uv.z;
+			v = uv.y + p.y * uv.w;
+		};
+
+		// the fan (0, i, i + 1, i + 2) matches the quad indices, an odd
+		// triangle count leaves the last quad's second triangle degenerate
+		const u32 stride = layout == LayoutPackedQuads ? sizeof(PackedVertex) * 4 : sizeof(Vertex) * 4;
+		for (u32 q = 0; q < mesh.quadCount(); q++) {
+			float xs[4], ys[4], us[4], vs[4];
+			corner(0, xs[0], ys[0], us[0], vs[0]);
+			for (u32 k = 1; k < 4; k++) corner(q * 2 + k, xs[k], ys[k], us[k], vs[k]);
+			writeVertices(dst + q * stride, layout, xs, ys, us, vs, cos, sin, sprite.color, slot, sprite.layer, sprite.depth);
+		}
+	}
+
+	SpriteBatch::BlendState SpriteBatch::blendState() const {
+		BlendState state;
+		std::memset(&state, 0, sizeof(BlendState));
+		state.enabled = m_blending;
+		state.src = m_srcFuncColor;
+		state.dst = m_dstFuncColor;
+		state.srcAlpha = m_srcFuncAlpha;
+		state.dstAlpha = m_dstFuncAlpha;
+		return state;
+	}
 
-		m_vertices.emplace_back(Vector2(x1, y1), Vector2(u1, v1), m_color, tangent);
-		m_vertices.emplace_back(Vector2(x2, y2), Vector2(u1, v2), m_color, tangent);
-		m_vertices.emplace_back(Vector2(x3, y3), Vector2(u2, v2), m_color, tangent);
-		m_vertices.emplace_back(Vector2(x4, y4), Vector2(u2, v1), m_color, tangent);
-		m_indices.insert(m_indices.end(), { off + 0, off + 1, off + 2, off + 0, off + 2, off + 3 });
+	void SpriteBatch::blendState(const BlendState& state) {
+		if (state.enabled) enableBlending();
+		else disableBlending();
+		blendFunctionSeparate(state.src, state.dst, state.srcAlpha, state.dstAlpha);
 	}
 
 	void SpriteBatch::blendFunctionSeparate(GLenum src, GLenum dst, GLenum srcAlpha, GLenum dstAlpha) {
 		if (m_srcFuncColor == src && m_dstFuncColor == dst && m_srcFuncAlpha == srcAlpha && m_dstFuncAlpha == dstAlpha) return;
-		flush();
+		if (m_sortMode == SortImmediate) flush(FlushBlend);
 		m_srcFuncColor = src;
 		m_dstFuncColor = dst;
 		m_srcFuncAlpha = srcAlpha;
@@ -234,13 +1637,13 @@ void main() {
 
 	void SpriteBatch::enableBlending() {
 		if (m_blending) return;
-		flush();
+		if (m_sortMode == SortImmediate) flush(FlushBlend);
 		m_blending = true;
 	}
 
 	void SpriteBatch::disableBlending() {
 		if (!m_blending) return;
-		flush();
+		if (m_sortMode == SortImmediate) flush(FlushBlend);
 		m_blending = false;
 	}
 
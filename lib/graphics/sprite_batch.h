@@ -4,17 +4,52 @@
 #include "buffer.h"
 #include "shader.h"
 #include "texture.h"
+#include "vertex_layout.h"
 #include "../math/math.hpp"
 #include "../stl.hpp"
 
+#include <unordered_map>
+
 namespace gt {
+	class SpriteLayer;
+	class GpuSpriteLayer;
+	class SpriteMesh;
+	class SpriteCommandList;
+
+	// Uniform block filled once per frame by SpriteBatch and bound at
+	// FrameConstantsBinding. Shaders can paste it in to read the matrices;
+	// the batch points the block at the binding when it first uses a shader.
+	constexpr u32 FrameConstantsBinding = 0;
+
+	inline static const std::string SBFrameConstants = R"(
+layout (std140, row_major) uniform FrameConstants {
+	mat4 uProjection;
+	mat4 uView;
+	mat4 uProjView;
+	vec2 uResolution;
+	float uTime;
+};
+)";
+
+	// std140 mirror of SBFrameConstants.
+	struct FrameConstants {
+		Matrix4 projection, view, projView;
+		Vector2 resolution;
+		float time;
+		float padding;
+	};
+	static_assert(sizeof(FrameConstants) == 208, "FrameConstants must match the std140 layout");
+
 	inline static const std::string SBVertexShader = R"(#version 430 core
 layout (location = 0) in vec2 vPosition;
 layout (location = 1) in vec2 vTexCoord;
 layout (location = 2) in vec4 vColor;
 layout (location = 3) in vec3 vTangent;
+layout (location = 4) in uint vTextureSlot;
+layout (location = 5) in uint vTextureLayer;
+layout (location = 6) in float vDepth;
 
-uniform mat4 uProjView = mat4(1.0);
+)" + SBFrameConstants + R"(
 
 out DATA {
 	vec4 color;
@@ -23,13 +58,18 @@ out DATA {
 	mat3 tbn;
 } VS;
 
+flat out int vsTextureSlot;
+flat out int vsTextureLayer;
+
 void main() {
-	vec4 pos = vec4(vPosition, 0.0, 1.0);
+	vec4 pos = vec4(vPosition, vDepth, 1.0);
 	gl_Position = uProjView * pos;
 
 	VS.color = vColor;
 	VS.position = pos;
 	VS.uv = vTexCoord;
+	vsTextureSlot = int(vTextureSlot);
+	vsTextureLayer = int(vTextureLayer);
 
 	const vec3 N = vec3(0.0, 0.0, 1.0);
 	vec3 T = normalize(vTangent - dot(vTangent, N) * N);
@@ -38,12 +78,141 @@ void main() {
 }
 )";
 
+	inline static const std::string SBInstancedVertexShader = R"(#version 430 core
+layout (location = 0) in vec2 iPosition;
+layout (location = 1) in vec2 iSize;
+layout (location = 2) in vec2 iOrigin;
+layout (location = 3) in float iRotation;
+layout (location = 4) in vec4 iColor;
+layout (location = 5) in vec4 iTexRect;
+layout (location = 6) in float iTextureSlot;
+layout (location = 7) in float iTextureLayer;
+layout (location = 8) in float iDepth;
+
+)" + SBFrameConstants + R"(
+
+out DATA {
+	vec4 color;
+	vec4 position;
+	vec2 uv;
+	mat3 tbn;
+} VS;
+
+flat out int vsTextureSlot;
+flat out int vsTextureLayer;
+
+const vec2 Corners[4] = vec2[](
+	vec2(0.0, 0.0), vec2(0.0, 1.0),
+	vec2(1.0, 1.0), vec2(1.0, 0.0)
+);
+
+void main() {
+	vec2 corner = Corners[gl_VertexID];
+	vec2 local = (corner - iOrigin) * iSize;
+
+	float c = cos(iRotation);
+	float s = sin(iRotation);
+	vec4 pos = vec4(
+		c * local.x - s * local.y + iPosition.x,
+		s * local.x + c * local.y + iPosition.y,
+		iDepth, 1.0
+	);
+	gl_Position = uProjView * pos;
+
+	VS.color = iColor;
+	VS.position = pos;
+	VS.uv = iTexRect.xy + corner * iTexRect.zw;
+	vsTextureSlot = int(iTextureSlot);
+	vsTextureLayer = int(iTextureLayer);
+
+	const vec3 N = vec3(0.0, 0.0, 1.0);
+	vec3 T = vec3(c, s, 0.0);
+	vec3 B = cross(T, N);
+	VS.tbn = mat3(T, B, N);
+}
+)";
+
+	// Shaders declaring `uniform sampler2D uTextures[N]` receive up to N textures
+	// per batch, bound to units 0..N-1, and read the sprite's index from
+	// `flat in int vsTextureSlot`. Other shaders only get uTexture (unit 0).
+	// Texture arrays follow the same convention with sampler2DArray, the layer
+	// arrives in `flat in int vsTextureLayer`.
+	constexpr u32 TextureSlots = 16;
+
+	// Default batch capacity, in sprites.
 	constexpr u32 SpritesCount = 30000;
+	constexpr u32 StreamSegments = 3;
+	constexpr u32 IndexedSprites = 65536 / 4;
 
 	class SpriteBatch {
 	public:
+		enum StreamMode {
+			StreamBuffered = 0,
+			StreamPersistent
+		};
+
+		// LayoutPackedQuads stores UVs as unorm16, so they are clamped to
+		// [0, 1]. Tiling or wrapping UVs need one of the other layouts.
+		enum Layout {
+			LayoutQuads = 0,
+			LayoutPackedQuads,
+			LayoutInstanced
+		};
+
+		// SortDepth draws in two passes at end() or flush(): opaque sprites
+		// front to back with depth writes and blending off, then translucent
+		// ones back to front with depth testing only. Greater depth is closer
+		// with the default projection. The target needs a cleared depth buffer.
+		enum SortMode {
+			SortImmediate = 0,
+			SortDeferred,
+			SortDepth
+		};
+
+		// What happens when a frame outgrows the batch capacity: split it into
+		// more draws, drop the extra sprites, or grow (doubling, up to
+		// maxCapacity when it's not 0) and split once the maximum is reached.
+		enum Growth {
+			GrowSplit = 0,
+			GrowFixed,
+			GrowGeometric
+		};
+
+		enum FlushReason {
+			FlushExplicit = 0,
+			FlushTexture,
+			FlushCapacity,
+			FlushShader,
+			FlushMatrix,
+			FlushBlend,
+			FlushLayer,
+			FlushPass,
+			FlushEnd,
+			FlushReasonCount
+		};
+
+		// Counters for the frame since begin(). Layer draws count their
+		// sprites and uploads but aren't flushes.
+		struct Stats {
+			u32 sprites, vertices, draws, flushes;
+			u64 bytes;
+			u32 reasons[FlushReasonCount];
+		};
+
+		struct FlushEvent {
+			FlushReason reason;
+			u32 sprites;
+		};
+
 		SpriteBatch() = default;
-		SpriteBatch(u32 width, u32 height);
+		SpriteBatch(
+			u32 width, u32 height,
+			StreamMode streamMode = StreamBuffered,
+			Layout layout = LayoutQuads,
+			u32 capacity = SpritesCount,
+			Growth growth = GrowSplit,
+			u32 maxCapacity = 0
+		);
 		~SpriteBatch();
 
 		void draw(
@@ -55,16 +224,128 @@ void main() {
 			Vector4 uv = Vector4(0, 0, 1, 1)
 		);
 
-		void begin();
+		void draw(
+			const Texture& textureArray,
+			u32 arrayLayer,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		// Draws the mesh's outline instead of the full frame. `uv` is the frame
+		// the mesh was built from. Instanced batches draw the quad. Deferred
+		// modes keep a pointer to the mesh until the sprites are emitted.
+		void draw(
+			const Texture& texture,
+			const SpriteMesh& mesh,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		// Structure-of-arrays input for drawMany. Null arrays fall back to the
+		// same defaults as draw(), colors to the current color. Sprites with a
+		// mesh skip the SIMD path; null entries draw quads and keep it.
+		struct SpriteArrays {
+			u32 count{ 0 };
+			const Vector2* positions{ nullptr };
+			const float* rotations{ nullptr };
+			const Vector2* origins{ nullptr };
+			const Vector2* scales{ nullptr };
+			const Vector4* uvs{ nullptr };
+			const Vector4* colors{ nullptr };
+			const float* depths{ nullptr };
+			const SpriteMesh* const* meshes{ nullptr };
+		};
+
+		void drawMany(const Texture& texture, const SpriteArrays& sprites);
+
+		void draw(SpriteLayer& layer);
+		void draw(GpuSpriteLayer& layer);
+
+		void begin(SortMode sortMode = SortImmediate);
 		void flush();
 		void end();
 
+		// Like begin(), but the flushed batches go into `list` instead of the
+		// screen until end(). Culling is skipped and layers can't be recorded.
+		void beginRecording(SpriteCommandList& list, SortMode sortMode = SortImmediate);
+
+		// Replays a recorded list, optionally transformed on top of the view.
+		void draw(SpriteCommandList& list);
+		void draw(SpriteCommandList& list, const Matrix4& transform);
+
+		// Recorders can be filled from worker threads between begin() and end().
+		// They generate vertices without touching GL; end() appends them in
+		// recorder order using the batch's shader and blend state at that time.
+		class Recorder {
+		public:
+			void reserve(u32 sprites);
+
+			void draw(
+				const Texture& texture,
+				Vector2 position,
+				float rotation = 0.0f,
+				Vector2 origin = Vector2(0.0f),
+				Vector2 scale = Vector2(1.0f),
+				Vector4 uv = Vector4(0, 0, 1, 1)
+			);
+
+			void draw(
+				const Texture& textureArray,
+				u32 arrayLayer,
+				Vector2 position,
+				float rotation = 0.0f,
+				Vector2 origin = Vector2(0.0f),
+				Vector2 scale = Vector2(1.0f),
+				Vector4 uv = Vector4(0, 0, 1, 1)
+			);
+
+			const Vector4& color() const { return m_color; }
+			void color(const Vector4& col) { m_color = col; }
+
+			float depth() const { return m_depth; }
+			void depth(float d) { m_depth = d; }
+
+			u32 count() const { return m_count; }
+			void clear();
+
+		private:
+			friend class SpriteBatch;
+
+			struct Run {
+				Texture texture;
+				u32 first, count;
+			};
+
+			std::vector<u8> m_data;
+			std::vector<Run> m_runs;
+			Layout m_layout{ LayoutQuads };
+			u32 m_stride{ 0 }, m_count{ 0 };
+			Vector4 m_color{ 1.0f };
+			float m_depth{ 0.0f };
+		};
+
+		void openRecorders(u32 count);
+		Recorder& recorder(u32 index) { return m_recorders[index]; }
+		u32 recorderCount() const { return m_recorders.size(); }
+
 		const Matrix4& projectionMatrix() const { return m_projection; }
 		const Matrix4& viewMatrix() const { return m_view; }
 
 		void projectionMatrix(const Matrix4& v);
 		void viewMatrix(const Matrix4& v);
 
+		// Written to FrameConstants at the next begin().
+		const Vector2& resolution() const { return m_resolution; }
+		void resolution(const Vector2& v) { m_resolution = v; }
+		float time() const { return m_time; }
+		void time(float t) { m_time = t; }
+
 		Shader& shader() { return m_currentShader; }
 		void shader(const Shader& s);
 		void resetShader() { shader(Shader(0)); }
@@ -72,6 +353,18 @@ void main() {
 		const Vector4& color() const { return m_color; }
 		void color(const Vector4& col) { m_color = col; }
 
+		// Draw order of deferred sprites, ignored by SortDepth.
+		u8 layer() const { return m_layer; }
+		void layer(u8 l) { m_layer = l; }
+
+		// Z of the following sprites, within the projection's depth range.
+		float depth() const { return m_depth; }
+		void depth(float d) { m_depth = d; }
+
+		// Marks the following sprites as fully opaque for SortDepth.
+		bool opaque() const { return m_opaque; }
+		void opaque(bool o) { m_opaque = o; }
+
 		GLenum blendSrcFunc() const { return m_srcFuncColor; }
 		GLenum blendDstFunc() const { return m_dstFuncColor; }
 		GLenum blendSrcFuncAlpha() const { return m_srcFuncAlpha; }
@@ -85,38 +378,248 @@ void main() {
 
 		bool isDrawing() const { return m_drawing; }
 
+		bool culling() const { return m_culling; }
+		void culling(bool enabled) { m_culling = enabled; }
+
+		// Sprites accepted and rejected by culling since begin().
+		u32 acceptedCount() const { return m_accepted; }
+		u32 culledCount() const { return m_culled; }
+
+		// Sprites dropped by a GrowFixed batch since begin().
+		u32 droppedCount() const { return m_dropped; }
+
+		u32 capacity() const { return m_capacity; }
+		Growth growth() const { return m_growth; }
+
+		const Stats& stats() const { return m_stats; }
+
+		// Keeps the last `size` flushes across frames, 0 turns tracing off.
+		void traceFlushes(u32 size);
+		// Traced flushes, oldest first.
+		std::vector<FlushEvent> flushEvents() const;
+
+		SortMode sortMode() const { return m_sortMode; }
+
+		StreamMode streamMode() const { return m_streamMode; }
+		Layout layout() const { return m_layout; }
+
+		const std::string& vertexShaderSource() const;
+
 	private:
+		friend class SpriteLayer;
+		friend class GpuSpriteLayer;
+		friend class SpriteCommandList;
+
+		// 52 bytes, depth is a half float like in PackedVertex.
 		struct Vertex {
 			Vector2 position;
 			Vector2 texCoord;
 			Vector4 color;
 			Vector3 tangent;
+			u16 slot;
+			u16 layer;
+			u16 depth;
 
 			Vertex() = default;
-			Vertex(const Vector2& pos, const Vector2& uv, const Vector4& col, const Vector3& tan)
-				: position(pos), texCoord(uv), color(col), tangent(tan) {}
+			Vertex(const Vector2& pos, const Vector2& uv, const Vector4& col, const Vector3& tan, u16 slot, u16 layer, u16 depth)
+				: position(pos), texCoord(uv), color(col), tangent(tan), slot(slot), layer(layer), depth(depth) {}
 		};
+		static_assert(sizeof(Vertex) == 52, "Vertex must stay 52 bytes.");
 
-		std::vector<Vertex> m_vertices;
-		std::vector<u32> m_indices;
+		// 24 bytes. UVs are unorm16 and clamped to [0, 1], array layers above
+		// 255 don't fit either; both need one of the other layouts.
+		struct PackedVertex {
+			Vector2 position;
+			u16 texCoord[2];
+			u8 color[4];
+			u16 tangent[2];
+			u8 slot;
+			u8 layer;
+			u16 depth;
+		};
+		static_assert(sizeof(PackedVertex) == 24, "PackedVertex must stay 24 bytes.");
 
-		VertexArray m_vao;
+		struct Instance {
+			Vector2 position;
+			Vector2 size;
+			Vector2 origin;
+			float rotation;
+			u8 color[4];
+			Vector4 uv;
+			u16 slot;
+			u16 layer;
+			float depth;
+		};
+
+		// Attribute order is the shader's location order.
+		static constexpr auto VertexAttributes = vertexLayout<Vertex>(
+			GT_VERTEX_ATTRIBUTE(Vertex, position),
+			GT_VERTEX_ATTRIBUTE(Vertex, texCoord),
+			GT_VERTEX_ATTRIBUTE(Vertex, color),
+			GT_VERTEX_ATTRIBUTE(Vertex, tangent),
+			GT_VERTEX_ATTRIBUTE_AS(Vertex, slot, AttributeInteger),
+			GT_VERTEX_ATTRIBUTE_AS(Vertex, layer, AttributeInteger),
+			GT_VERTEX_ATTRIBUTE_AS(Vertex, depth, AttributeHalf)
+		);
+
+		static constexpr auto PackedVertexAttributes = vertexLayout<PackedVertex>(
+			GT_VERTEX_ATTRIBUTE(PackedVertex, position),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, texCoord, AttributeNormalized),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, color, AttributeNormalized),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, tangent, AttributeHalf),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, slot, AttributeInteger),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, layer, AttributeInteger),
+			GT_VERTEX_ATTRIBUTE_AS(PackedVertex, depth, AttributeHalf)
+		);
+
+		static constexpr auto InstanceAttributes = vertexLayout<Instance>(
+			GT_VERTEX_ATTRIBUTE(Instance, position),
+			GT_VERTEX_ATTRIBUTE(Instance, size),
+			GT_VERTEX_ATTRIBUTE(Instance, origin),
+			GT_VERTEX_ATTRIBUTE(Instance, rotation),
+			GT_VERTEX_ATTRIBUTE_AS(Instance, color, AttributeNormalized),
+			GT_VERTEX_ATTRIBUTE(Instance, uv),
+			GT_VERTEX_ATTRIBUTE(Instance, slot),
+			GT_VERTEX_ATTRIBUTE(Instance, layer),
+			GT_VERTEX_ATTRIBUTE(Instance, depth)
+		);
+
+		static_assert(VertexAttributes.valid(), "Invalid Vertex layout.");
+		static_assert(PackedVertexAttributes.valid(), "Invalid PackedVertex layout.");
+		static_assert(InstanceAttributes.valid(), "Invalid Instance layout.");
+
+		struct BlendState {
+			bool enabled;
+			GLenum src, dst, srcAlpha, dstAlpha;
+		};
+
+		struct Sprite {
+			Vector2 position;
+			float rotation;
+			Vector2 origin;
+			Vector2 scale;
+			Vector4 uv;
+			Vector4 color;
+			u32 layer;
+			float depth;
+			const SpriteMesh* mesh{ nullptr };
+		};
+
+		std::vector<u8> m_storage;
+		std::vector<Recorder> m_recorders;
+
+		std::vector<Sprite> m_commands;
+		std::vector<u32> m_commandStates;
+		std::vector<u64> m_keys, m_sortScratch;
+		std::vector<Shader> m_sortShaders;
+		std::vector<BlendState> m_sortBlends;
+		std::vector<Texture> m_sortTextures;
+		std::unordered_map<GLuint, u32> m_sortTextureIndices;
+		SortMode m_sortMode{ SortImmediate };
+		u8 m_layer{ 0 };
+		float m_depth{ 0.0f };
+		bool m_opaque{ false };
+
+		StreamMode m_streamMode{ StreamBuffered };
+		Layout m_layout{ LayoutQuads };
+		u32 m_stride{ 0 };
+
+		u8* m_mapped{ nullptr };
+		GLsync m_fences[StreamSegments]{};
+		u32 m_segment{ 0 }, m_count{ 0 }, m_batchStart{ 0 };
+
+		Growth m_growth{ GrowSplit };
+		u32 m_capacity{ 0 }, m_maxCapacity{ 0 };
+		u32 m_frameCount{ 0 }, m_dropped{ 0 };
+
+		Stats m_stats{};
+		std::vector<FlushEvent> m_trace;
+		u32 m_traceNext{ 0 };
+
+		VertexFormat m_format;
 		Buffer m_vbo, m_ibo;
 
-		Matrix4 m_projection, m_view;
+		Matrix4 m_projection, m_view, m_projView;
+
+		Shader m_defaultShader, m_defaultArrayShader, m_currentShader;
+
+		Texture m_textures[TextureSlots];
+		u32 m_textureCount{ 0 }, m_textureSlots{ 1 }, m_maxTextureSlots{ 1 }, m_lastSlot{ 0 };
+
+		// Per program setup done the first time it's used. Shaders with their
+		// own `uniform mat4 uProjView` still get it set on every switch.
+		// Dropped when GLState reports a deleted program, GL reuses ids.
+		struct ShaderInfo {
+			u32 slots;
+			i32 projView;
+		};
+		std::unordered_map<GLuint, ShaderInfo> m_shaders;
+		u32 m_programGeneration{ 0 };
 
-		Shader m_defaultShader, m_currentShader;
-		Texture m_lastTexture{};
+		Buffer m_frameConstants;
+		Vector2 m_resolution{ 0.0f };
+		float m_time{ 0.0f };
 
 		Vector4 m_color{ 1.0f };
 
 		bool m_drawing{ false };
+		SpriteCommandList* m_recording{ nullptr };
+		bool m_depthTest{ false }, m_depthWrite{ false };
+
+		bool m_culling{ false };
+		Vector4 m_viewRect{ 0.0f };
+		u32 m_accepted{ 0 }, m_culled{ 0 };
 
 		bool m_blending{ false };
-		GLenum m_srcFuncColor, m_dstFuncColor, m_srcFuncAlpha, m_dstFuncAlpha;
+		GLenum m_srcFuncColor{ GLenum(-1) }, m_dstFuncColor{ GLenum(-1) };
+		GLenum m_srcFuncAlpha{ GLenum(-1) }, m_dstFuncAlpha{ GLenum(-1) };
+
+		void setupFrame();
+		void setupShader();
+		void setupBlending();
+		void depthState(bool test, bool write);
+		void replay(SpriteCommandList& list);
+		bool visible(const Vector2& position, float rotation, float fx, float fy, float fx2, float fy2) const;
+		const VertexFormat& vertexFormat() const { return m_format; }
+		void bindVertexArray();
+		// Sprites are written to the persistent mapping. Recordings go to
+		// m_storage instead, the mapping is write only.
+		bool mapped() const { return m_mapped && !m_recording; }
+		u32 textureSlot(const Texture& tex);
+		void nextSegment();
+		void allocate(u32 capacity);
+		u32 room(u32 count);
+		u8* cursor();
+
+		void queue(const Texture& texture, const Sprite& sprite);
+		void submit(const Texture& texture, const Sprite& sprite);
+		void stitch();
+		void patchSlots(u8* dst, u32 count, u32 slot) const;
+		static void writeSprite(u8* dst, Layout layout, const Texture& texture, const Sprite& sprite, u32 slot);
+		static void writeInstance(
+			u8* dst,
+			const Vector2& position, const Vector2& size, const Vector2& origin, float rotation,
+			const Vector4& uv, const Vector4& color, u32 slot, u32 layer, float depth
+		);
+		static void writeQuad(
+			u8* dst, Layout layout,
+			const float* xs, const float* ys, float cos, float sin,
+			const Vector4& uv, const Vector4& color, u32 slot, u32 layer, float depth
+		);
+		static void writeVertices(
+			u8* dst, Layout layout,
+			const float* xs, const float* ys, const float* us, const float* vs, float cos, float sin,
+			const Vector4& color, u32 slot, u32 layer, float depth
+		);
+		static void writeMesh(u8* dst, Layout layout, const Texture& texture, const Sprite& sprite, u32 slot);
+		void record(const Texture& texture, const Sprite& sprite);
+		void emit(FlushReason reason);
+		void flush(FlushReason reason);
+
+		const Shader& shaderFor(const Texture& texture) const;
 
-		void setupMatrices();
-		void switchTexture(const Texture& tex);
+		BlendState blendState() const;
+		void blendState(const BlendState& state);
 	};
 }
 
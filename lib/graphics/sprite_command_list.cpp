@@ -0,0 +1,36 @@
+#include "sprite_command_list.h"
+
+namespace gt {
+
+	SpriteCommandList::~SpriteCommandList() {
+		clear();
+	}
+
+	void SpriteCommandList::clear() {
+		m_vbo.destroy();
+		m_data.clear();
+		m_batches.clear();
+		m_count = 0;
+	}
+
+	void SpriteCommandList::append(const u8* data, u32 count, const Batch& batch) {
+		m_data.insert(m_data.end(), data, data + count * m_stride);
+		m_batches.push_back(batch);
+		m_batches.back().first = m_count;
+		m_batches.back().count = count;
+		m_count += count;
+	}
+
+	void SpriteCommandList::upload() {
+		if (m_count == 0) return;
+
+		// drawn through the batch's cached vertex array
+		m_vbo = Buffer().create(Buffer::ArrayBuffer).bind();
+		m_vbo.update(m_data, Buffer::StaticDraw);
+
+		// the GPU copy is all a replay needs
+		m_data.clear();
+		m_data.shrink_to_fit();
+	}
+
+}
@@ -0,0 +1,52 @@
+#ifndef SPRITE_COMMAND_LIST_H
+#define SPRITE_COMMAND_LIST_H
+
+#include "sprite_batch.h"
+
+namespace gt {
+	// Sprites recorded once between SpriteBatch::beginRecording() and end(),
+	// replayed with SpriteBatch::draw(list). The vertices stay on the GPU with
+	// the batch boundaries and the state each batch was flushed with, so a
+	// replay costs one draw per recorded batch. Lists borrow the index buffer
+	// of the batch that recorded them and are only valid on that batch.
+	class SpriteCommandList {
+	public:
+		SpriteCommandList() = default;
+		~SpriteCommandList();
+
+		SpriteCommandList(const SpriteCommandList&) = delete;
+		SpriteCommandList& operator=(const SpriteCommandList&) = delete;
+
+		void clear();
+
+		u32 count() const { return m_count; }
+		u32 batchCount() const { return m_batches.size(); }
+		bool empty() const { return m_count == 0; }
+
+	private:
+		friend class SpriteBatch;
+
+		struct Batch {
+			u32 first, count;
+			Shader shader;
+			SpriteBatch::BlendState blend;
+			bool depthTest, depthWrite;
+			Texture textures[TextureSlots];
+			u32 textureCount;
+		};
+
+		SpriteBatch::Layout m_layout{ SpriteBatch::LayoutQuads };
+		u32 m_stride{ 0 };
+
+		Buffer m_vbo;
+
+		std::vector<u8> m_data;
+		std::vector<Batch> m_batches;
+		u32 m_count{ 0 };
+
+		void append(const u8* data, u32 count, const Batch& batch);
+		void upload();
+	};
+}
+
+#endif // SPRITE_COMMAND_LIST_H
@@ -0,0 +1,107 @@
+#include "sprite_layer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gt {
+
+	// clean gaps up to this many sprites are uploaded along with their neighbours
+	static constexpr u32 MergeGap = 16;
+
+	SpriteLayer::SpriteLayer(const SpriteBatch& batch, const Texture& texture, u32 capacity) {
+		m_layout = batch.m_layout;
+		m_stride = batch.m_stride;
+		m_texture = texture;
+		m_capacity = std::max(capacity, 1u);
+		m_data.resize(m_capacity * m_stride);
+		m_alive.resize(m_capacity);
+		m_resized = true;
+
+		m_format = batch.vertexFormat();
+		m_vbo = Buffer().create(Buffer::ArrayBuffer);
+	}
+
+	SpriteLayer::~SpriteLayer() {
+		m_vbo.destroy();
+	}
+
+	SpriteLayer::Handle SpriteLayer::add(Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		return add(0, position, rotation, origin, scale, uv);
+	}
+
+	SpriteLayer::Handle SpriteLayer::add(u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		Handle handle;
+		if (!m_free.empty()) {
+			handle = m_free.back();
+			m_free.pop_back();
+		} else {
+			if (m_count == m_capacity) {
+				m_capacity *= 2;
+				m_data.resize(m_capacity * m_stride);
+				m_alive.resize(m_capacity);
+				m_resized = true;
+			}
+			handle = m_count++;
+		}
+		m_alive[handle] = true;
+		write(handle, arrayLayer, position, rotation, origin, scale, uv);
+		return handle;
+	}
+
+	void SpriteLayer::update(Handle handle, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		update(handle, 0, position, rotation, origin, scale, uv);
+	}
+
+	void SpriteLayer::update(Handle handle, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		if (!alive(handle)) return;
+		write(handle, arrayLayer, position, rotation, origin, scale, uv);
+	}
+
+	void SpriteLayer::remove(Handle handle) {
+		if (!alive(handle)) return;
+		m_alive[handle] = false;
+		// a zeroed sprite is degenerate in every layout
+		std::memset(m_data.data() + handle * m_stride, 0, m_stride);
+		invalidate(handle);
+		m_free.push_back(handle);
+	}
+
+	void SpriteLayer::clear() {
+		m_count = 0;
+		m_free.clear();
+		m_vbo.clearDirty();
+	}
+
+	void SpriteLayer::write(Handle handle, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv) {
+		SpriteBatch::Sprite sprite;
+		sprite.position = position;
+		sprite.rotation = rotation;
+		sprite.origin = origin;
+		sprite.scale = scale;
+		sprite.uv = uv;
+		sprite.color = m_color;
+		sprite.layer = arrayLayer;
+		sprite.depth = 0.0f;
+		SpriteBatch::writeSprite(m_data.data() + handle * m_stride, m_layout, m_texture, sprite, 0);
+		invalidate(handle);
+	}
+
+	void SpriteLayer::invalidate(Handle handle) {
+		if (m_resized) return;
+		m_vbo.markDirty(handle * m_stride, m_stride);
+	}
+
+	u32 SpriteLayer::upload() {
+		u32 bytes = 0;
+		if (m_resized) {
+			m_vbo.bind().update(m_data.data(), m_data.size(), Buffer::StaticDraw);
+			bytes = m_data.size();
+		} else if (m_vbo.dirty()) {
+			bytes = m_vbo.bind().uploadDirty(m_data.data(), MergeGap * m_stride);
+		}
+		m_vbo.clearDirty();
+		m_resized = false;
+		return bytes;
+	}
+
+}
@@ -0,0 +1,91 @@
+#ifndef SPRITE_LAYER_H
+#define SPRITE_LAYER_H
+
+#include "sprite_batch.h"
+
+namespace gt {
+	// Retained sprites drawn with SpriteBatch::draw(layer). Vertices are kept
+	// on the GPU and only the ranges touched since the last draw are uploaded.
+	// Indices come from the drawing batch's quad index buffer.
+	class SpriteLayer {
+	public:
+		using Handle = u32;
+
+		SpriteLayer(const SpriteBatch& batch, const Texture& texture, u32 capacity = 1024);
+		~SpriteLayer();
+
+		Handle add(
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		Handle add(
+			u32 arrayLayer,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		void update(
+			Handle handle,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		void update(
+			Handle handle,
+			u32 arrayLayer,
+			Vector2 position,
+			float rotation = 0.0f,
+			Vector2 origin = Vector2(0.0f),
+			Vector2 scale = Vector2(1.0f),
+			Vector4 uv = Vector4(0, 0, 1, 1)
+		);
+
+		void remove(Handle handle);
+		void clear();
+
+		const Vector4& color() const { return m_color; }
+		void color(const Vector4& col) { m_color = col; }
+
+		const Texture& texture() const { return m_texture; }
+
+		u32 count() const { return m_count - m_free.size(); }
+		u32 capacity() const { return m_capacity; }
+
+	private:
+		friend class SpriteBatch;
+
+		SpriteBatch::Layout m_layout;
+		u32 m_stride;
+		Texture m_texture;
+
+		VertexFormat m_format;
+		Buffer m_vbo;
+
+		std::vector<u8> m_data;
+		std::vector<Handle> m_free;
+		// false for removed handles sitting on m_free
+		std::vector<bool> m_alive;
+		u32 m_count{ 0 }, m_capacity{ 0 };
+		bool m_resized{ false };
+
+		Vector4 m_color{ 1.0f };
+
+		bool alive(Handle handle) const { return handle < m_count && m_alive[handle]; }
+		void write(Handle handle, u32 arrayLayer, Vector2 position, float rotation, Vector2 origin, Vector2 scale, Vector4 uv);
+		void invalidate(Handle handle);
+		// Returns the bytes sent to the GPU.
+		u32 upload();
+	};
+}
+
+#endif // SPRITE_LAYER_H
@@ -0,0 +1,141 @@
+#include "sprite_mesh.h"
+
+#include <algorithm>
+
+namespace gt {
+
+	static float cross2(const Vector2& a, const Vector2& b) {
+		return a.x * b.y - a.y * b.x;
+	}
+
+	static float polygonArea(const std::vector<Vector2>& poly) {
+		float area = 0.0f;
+		for (size_t i = 0; i < poly.size(); i++) {
+			area += cross2(poly[i], poly[(i + 1) % poly.size()]);
+		}
+		return std::abs(area) * 0.5f;
+	}
+
+	// Convex hull of the kept pixels' corners, in frame pixels.
+	static std::vector<Vector2> alphaHull(
+		const u8* rgba, u32 width, u32 height,
+		const Vector4& frame, u8 threshold,
+		Vector2& size
+	) {
+		const u32 x0 = std::min(u32(frame.x * width + 0.5f), width);
+		const u32 y0 = std::min(u32(frame.y * height + 0.5f), height);
+		const u32 x1 = std::min(u32((frame.x + frame.z) * width + 0.5f), width);
+		const u32 y1 = std::min(u32((frame.y + frame.w) * height + 0.5f), height);
+		size = Vector2(float(x1 - x0), float(y1 - y0));
+
+		// only the outermost pixels of each row can be on the hull
+		std::vector<Vector2> points;
+		for (u32 y = y0; y < y1; y++) {
+			const u8* row = rgba + (y * width) * 4;
+			u32 left = x1, right = x0;
+			for (u32 x = x0; x < x1; x++) {
+				if (row[x * 4 + 3] <= threshold) continue;
+				left = std::min(left, x);
+				right = x;
+			}
+			if (left > right) continue;
+
+			const float fy = float(y - y0);
+			const float fl = float(left - x0), fr = float(right + 1 - x0);
+			points.insert(points.end(), {
+				Vector2(fl, fy), Vector2(fl, fy + 1.0f),
+				Vector2(fr, fy), Vector2(fr, fy + 1.0f)
+			});
+		}
+		if (points.size() < 3) return {};
+
+		// monotone chain, collinear points are dropped
+		std::sort(points.begin(), points.end(), [](const Vector2& a, const Vector2& b) {
+			return a.x < b.x || (a.x == b.x && a.y < b.y);
+		});
+
+		std::vector<Vector2> hull(points.size() * 2);
+		size_t k = 0;
+		for (size_t i = 0; i < points.size(); i++) {
+			while (k >= 2 && cross2(hull[k - 1] - hull[k - 2], points[i] - hull[k - 2]) <= 0.0f) k--;
+			hull[k++] = points[i];
+		}
+		for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--) {
+			while (k >= lower && cross2(hull[k - 1] - hull[k - 2], points[i - 1] - hull[k - 2]) <= 0.0f) k--;
+			hull[k++] = points[i - 1];
+		}
+		hull.resize(k - 1);
+		return hull;
+	}
+
+	// Removes the edge whose neighbours, extended until they meet, add the
+	// least area. The meeting point has to stay inside the frame so the
+	// outline never samples a neighbouring frame.
+	static bool cutEdge(std::vector<Vector2>& poly, const Vector2& size) {
+		const size_t n = poly.size();
+		if (n <= 3) return false;
+
+		size_t best = n;
+		float bestArea = INFINITY;
+		Vector2 bestPoint;
+		for (size_t i = 0; i < n; i++) {
+			const Vector2& a = poly[(i + n - 1) % n];
+			const Vector2& b = poly[i];
+			const Vector2& c = poly[(i + 1) % n];
+			const Vector2& d = poly[(i + 2) % n];
+
+			const Vector2 dirB = b - a, dirC = c - d;
+			const float denom = cross2(dirB, dirC);
+			if (std::abs(denom) < Epsilon) continue;
+
+			const float t = cross2(c - b, dirC) / denom;
+			const float s = cross2(c - b, dirB) / denom;
+			if (t <= 0.0f || s <= 0.0f) continue;
+
+			const Vector2 q = b + dirB * t;
+			if (q.x < -Epsilon || q.y < -Epsilon || q.x > size.x + Epsilon || q.y > size.y + Epsilon) continue;
+
+			const float area = std::abs(cross2(b - q, c - q)) * 0.5f;
+			if (area < bestArea) {
+				bestArea = area;
+				best = i;
+				bestPoint = q;
+			}
+		}
+		if (best == n) return false;
+
+		poly[best] = bestPoint;
+		poly.erase(poly.begin() + (best + 1) % n);
+		return true;
+	}
+
+	SpriteMesh SpriteMesh::fromAlpha(const u8* rgba, u32 width, u32 height, const Vector4& frame, u32 maxVertices, u8 threshold) {
+		SpriteMesh mesh;
+		Vector2 size;
+		std::vector<Vector2> poly = alphaHull(rgba, width, height, frame, threshold, size);
+		if (poly.empty()) return mesh;
+
+		while (poly.size() > std::max(maxVertices, 3u) && cutEdge(poly, size));
+
+		mesh.m_area = polygonArea(poly) / (size.x * size.y);
+		mesh.m_points.reserve(poly.size());
+		for (const Vector2& p : poly) {
+			mesh.m_points.push_back(Vector2(p.x / size.x, p.y / size.y));
+		}
+		return mesh;
+	}
+
+	std::vector<SpriteMesh::Fit> SpriteMesh::survey(const u8* rgba, u32 width, u32 height, const Vector4& frame, u8 threshold) {
+		std::vector<Fit> fits;
+		Vector2 size;
+		std::vector<Vector2> poly = alphaHull(rgba, width, height, frame, threshold, size);
+		if (poly.empty()) return fits;
+
+		const float frameArea = size.x * size.y;
+		do {
+			fits.push_back({ u32(poly.size()), polygonArea(poly) / frameArea });
+		} while (cutEdge(poly, size));
+		return fits;
+	}
+
+}
@@ -0,0 +1,53 @@
+#ifndef SPRITE_MESH_H
+#define SPRITE_MESH_H
+
+#include "../math/math.hpp"
+#include "../stl.hpp"
+
+#include <vector>
+
+namespace gt {
+	// Convex outline around the opaque pixels of a sprite frame, in frame
+	// coordinates (0..1 across the frame). SpriteBatch draws it as a fan in
+	// place of the full quad, spending vertices to skip blended fragments.
+	class SpriteMesh {
+	public:
+		struct Fit {
+			u32 vertices;
+			float area;
+		};
+
+		SpriteMesh() = default;
+
+		// `rgba` is a width x height RGBA8 image, `frame` the uv rect of the frame
+		// in it. Pixels with alpha above `threshold` are kept inside the outline.
+		static SpriteMesh fromAlpha(
+			const u8* rgba, u32 width, u32 height,
+			const Vector4& frame = Vector4(0, 0, 1, 1),
+			u32 maxVertices = 8,
+			u8 threshold = 0
+		);
+
+		// Frame area covered by the outline for every vertex count it can be cut
+		// down to, from the convex hull to a triangle. A quad covers 1.0.
+		static std::vector<Fit> survey(
+			const u8* rgba, u32 width, u32 height,
+			const Vector4& frame = Vector4(0, 0, 1, 1),
+			u8 threshold = 0
+		);
+
+		const std::vector<Vector2>& points() const { return m_points; }
+		u32 vertexCount() const { return m_points.size(); }
+		// Batch quads the fan is split into, two triangles each.
+		u32 quadCount() const { return m_points.size() < 3 ? 0 : (m_points.size() - 1) / 2; }
+		// Covered fraction of the frame.
+		float area() const { return m_area; }
+		bool empty() const { return m_points.size() < 3; }
+
+	private:
+		std::vector<Vector2> m_points;
+		float m_area{ 0.0f };
+	};
+}
+
+#endif // SPRITE_MESH_H
@@ -1,8 +1,10 @@
 #include "texture.h"
+#include "gl_state.h"
 
 namespace gt {
 	void Texture::destroy() {
 		if (m_id) {
+			GLState::get().forgetTexture(m_id);
 			glDeleteTextures(1, &m_id);
 			m_id = 0;
 		}
@@ -38,10 +40,10 @@ namespace gt {
 		return *this;
 	}
 
-	Texture& Texture::array(u32 layerCount) {
+	Texture& Texture::array(u32 layerCount, u32 levels) {
 		if (layerCount > 0 && m_type == TextureType::Texture2DArray) {
 			glTexStorage3D(
-				m_type, 0,
+				m_type, levels,
 				getInternalFormat(m_format, m_floatingPoint, m_depthSize),
 				m_width, m_height,
 				layerCount
@@ -51,6 +53,21 @@ namespace gt {
 		return *this;
 	}
 
+	Texture& Texture::createArray(
+		Format format,
+		u32 width, u32 height,
+		const std::vector<const u8*>& layers,
+		DataType dataType,
+		u32 levels
+	) {
+		create(TextureType::Texture2DArray, format, width, height, layers.size()).bind()
+			.array(layers.size(), levels);
+		for (u32 i = 0; i < layers.size(); i++) {
+			updateLayer(i, layers[i], dataType);
+		}
+		return *this;
+	}
+
 	Texture& Texture::updateCube(const u8* data, CubeMapSide side, DataType dataType) {
 		GLenum ifmt = getInternalFormat(m_format, m_floatingPoint, m_depthSize);
 		if (m_type == TextureType::CubeMap) {
@@ -75,6 +92,20 @@ namespace gt {
 		return *this;
 	}
 
+	Texture& Texture::updateLayer(u32 layer, const u8* data, DataType dataType) {
+		if (layer < m_layerCount && m_type == TextureType::Texture2DArray) {
+			glTexSubImage3D(
+				m_type,
+				0, 0, 0, layer,
+				m_width, m_height, 1,
+				m_format,
+				dataType,
+				data
+			);
+		}
+		return *this;
+	}
+
 	Texture& Texture::update(const u8* data, DataType dataType) {
 		GLenum ifmt = getInternalFormat(m_format, m_floatingPoint, m_depthSize);
 		switch (m_type) {
@@ -98,13 +129,12 @@ namespace gt {
 	}
 
 	Texture& Texture::bind(u32 slot) {
-		glActiveTexture(GL_TEXTURE0 + slot);
-		glBindTexture(m_type, m_id);
+		GLState::get().texture(slot, m_type, m_id);
 		return *this;
 	}
 
 	Texture& Texture::unbind() {
-		glBindTexture(m_type, 0);
+		GLState::get().texture(m_type, 0);
 		return *this;
 	}
 }
\ No newline at end of file
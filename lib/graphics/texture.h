@@ -71,10 +71,18 @@ namespace gt {
 		Texture& wrapMode(TextureWrap s, TextureWrap t, TextureWrap r = TextureWrap::WrapNone);
 		Texture& filter(TextureFilter min, TextureFilter mag);
 
-		Texture& array(u32 layerCount);
+		Texture& array(u32 layerCount, u32 levels = 1);
+		Texture& createArray(
+			Format format,
+			u32 width, u32 height,
+			const std::vector<const u8*>& layers,
+			DataType dataType = DataType::TypeUByte,
+			u32 levels = 1
+		);
 
 		Texture& updateCube(const u8* data, CubeMapSide side, DataType dataType = DataType::TypeUByte);
 		Texture& updateArray(const u8* data, DataType dataType = DataType::TypeUByte);
+		Texture& updateLayer(u32 layer, const u8* data, DataType dataType = DataType::TypeUByte);
 		Texture& update(const u8* data, DataType dataType);
 
 		Texture& generateMipmaps();
@@ -93,7 +101,7 @@ namespace gt {
 
 	private:
 		GLuint m_id{ 0 };
-		TextureType m_type;
+		TextureType m_type{ TextureType::Texture2D };
 		Format m_format;
 
 		bool m_floatingPoint{ false };
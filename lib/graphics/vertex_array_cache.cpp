@@ -0,0 +1,73 @@
+#include "vertex_array_cache.h"
+#include "gl_state.h"
+
+namespace gt {
+
+	VertexArrayCache& VertexArrayCache::get() {
+		thread_local VertexArrayCache cache;
+		return cache;
+	}
+
+	void VertexArrayCache::bind(const VertexFormat& format, const Buffer& vbo, const Buffer& ibo, u32 offset) {
+		bind(format, vbo, offset);
+		// GLState tracks the element buffer of the bound vertex array
+		GLState::get().buffer(GL_ELEMENT_ARRAY_BUFFER, ibo.id());
+	}
+
+	void VertexArrayCache::bind(const VertexFormat& format, const Buffer& vbo, u32 offset) {
+		Entry& e = entry(format);
+		e.vao.bind();
+		if (e.vbo == vbo.id() && e.offset == offset) return;
+
+		glBindVertexBuffer(0, vbo.id(), offset, format.stride());
+		e.vbo = vbo.id();
+		e.offset = offset;
+		m_binds++;
+	}
+
+	void VertexArrayCache::unbind() {
+		GLState::get().vertexArray(0);
+	}
+
+	void VertexArrayCache::forgetBuffer(GLuint id) {
+		for (auto& [hash, bucket] : m_arrays) {
+			for (Entry& e : bucket) {
+				if (e.vbo == id) e.vbo = Unknown;
+			}
+		}
+	}
+
+	void VertexArrayCache::invalidate(bool contextLost) {
+		if (contextLost) {
+			m_arrays.clear();
+			m_count = 0;
+			return;
+		}
+		for (auto& [hash, bucket] : m_arrays) {
+			for (Entry& e : bucket) e.vbo = Unknown;
+		}
+	}
+
+	void VertexArrayCache::clear() {
+		for (auto& [hash, bucket] : m_arrays) {
+			for (Entry& e : bucket) e.vao.destroy();
+		}
+		m_arrays.clear();
+		m_count = 0;
+	}
+
+	VertexArrayCache::Entry& VertexArrayCache::entry(const VertexFormat& format) {
+		std::vector<Entry>& bucket = m_arrays[format.hash()];
+		for (Entry& e : bucket) {
+			if (e.format == format) return e;
+		}
+
+		Entry& e = bucket.emplace_back();
+		e.format = format;
+		e.vao = VertexArray().create().bind();
+		format.enableFormat(0);
+		m_count++;
+		return e;
+	}
+
+}
@@ -0,0 +1,56 @@
+#ifndef VERTEX_ARRAY_CACHE_H
+#define VERTEX_ARRAY_CACHE_H
+
+#include "buffer.h"
+
+#include <unordered_map>
+
+namespace gt {
+	// One vertex array per vertex format, shared by every buffer using that
+	// format. Attribute formats are set once with glVertexAttribFormat, so
+	// drawing another buffer with the same format only swaps the vertex buffer
+	// binding. Like GLState there is one per thread, and clear() has to run
+	// while the context is still current.
+	class VertexArrayCache {
+	public:
+		static VertexArrayCache& get();
+
+		// Binds the vertex array for `format`, reading vertices from `vbo`
+		// starting at `offset` bytes, and indices from `ibo`.
+		void bind(const VertexFormat& format, const Buffer& vbo, const Buffer& ibo, u32 offset = 0);
+		void bind(const VertexFormat& format, const Buffer& vbo, u32 offset = 0);
+		void unbind();
+
+		// Called by Buffer::destroy(), GL may hand the name out again.
+		void forgetBuffer(GLuint id);
+		// Forgets which buffers are bound, for raw GL changes. With
+		// `contextLost` the arrays themselves are gone and are dropped.
+		void invalidate(bool contextLost = false);
+		// Deletes every array, the context must still be current.
+		void clear();
+
+		u32 size() const { return m_count; }
+		u32 vertexBufferBinds() const { return m_binds; }
+		void resetCounters() { m_binds = 0; }
+
+	private:
+		static constexpr GLuint Unknown = ~0u;
+
+		struct Entry {
+			VertexFormat format;
+			VertexArray vao;
+			GLuint vbo{ Unknown };
+			u32 offset{ 0 };
+		};
+
+		// formats with the same hash share a bucket
+		std::unordered_map<u64, std::vector<Entry>> m_arrays;
+		u32 m_count{ 0 }, m_binds{ 0 };
+
+		VertexArrayCache() = default;
+
+		Entry& entry(const VertexFormat& format);
+	};
+}
+
+#endif // VERTEX_ARRAY_CACHE_H
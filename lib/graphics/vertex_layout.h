@@ -0,0 +1,99 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include "buffer.h"
+#include "../math/vector.hpp"
+#include "../stl.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace gt {
+	// Component count and GL type of a vertex struct member.
+	template <typename T> struct AttributeTraits;
+
+	template <size_t N> struct AttributeTraits<Vec<N>> {
+		static_assert(sizeof(Vec<N>) == sizeof(float) * N, "Vec<N> must be tightly packed.");
+		static constexpr DataType type = TypeFloat;
+		static constexpr u8 size = N;
+		static constexpr bool integer = false;
+	};
+
+#define GT_ATTRIBUTE_TRAITS(T, Type, Integer) \
+	template <> struct AttributeTraits<T> { \
+		static constexpr DataType type = Type; \
+		static constexpr u8 size = 1; \
+		static constexpr bool integer = Integer; \
+	};
+
+	GT_ATTRIBUTE_TRAITS(float, TypeFloat, false)
+	GT_ATTRIBUTE_TRAITS(i8, TypeByte, true)
+	GT_ATTRIBUTE_TRAITS(u8, TypeUByte, true)
+	GT_ATTRIBUTE_TRAITS(i16, TypeShort, true)
+	GT_ATTRIBUTE_TRAITS(u16, TypeUShort, true)
+	GT_ATTRIBUTE_TRAITS(i32, TypeInt, true)
+	GT_ATTRIBUTE_TRAITS(u32, TypeUInt, true)
+
+#undef GT_ATTRIBUTE_TRAITS
+
+	// Arrays of scalars, like `u8 color[4]`.
+	template <typename T, size_t N> struct AttributeTraits<T[N]> {
+		static_assert(AttributeTraits<T>::size == 1, "Attribute arrays must hold scalars.");
+		static_assert(N >= 1 && N <= 4, "Attributes have 1 to 4 components.");
+		static constexpr DataType type = AttributeTraits<T>::type;
+		static constexpr u8 size = N;
+		static constexpr bool integer = AttributeTraits<T>::integer;
+	};
+
+	template <typename Member, AttributeMode Mode = AttributeFloat>
+	constexpr VertexAttribute vertexAttribute(u32 offset) {
+		using Traits = AttributeTraits<Member>;
+		static_assert(Mode == AttributeFloat || Traits::integer, "Only integer members can be normalized, integer or half attributes.");
+		static_assert(Mode != AttributeHalf || Traits::type == TypeUShort, "Half float members are stored as u16.");
+
+		if constexpr (Mode == AttributeHalf) {
+			return { TypeHalfFloat, Traits::size, AttributeFloat, offset };
+		} else {
+			return { Traits::type, Traits::size, Mode, offset };
+		}
+	}
+
+	// Attribute locations follow the order the members are listed in, offsets
+	// and types come from the struct itself.
+	template <typename Vertex, size_t N>
+	struct VertexLayout {
+		std::array<VertexAttribute, N> attributes;
+
+		static constexpr u32 stride = sizeof(Vertex);
+
+		// Every attribute inside the struct, none overlapping.
+		constexpr bool valid() const {
+			for (size_t i = 0; i < N; i++) {
+				const VertexAttribute& a = attributes[i];
+				if (a.size < 1 || a.size > 4 || a.offset + a.bytes() > stride) return false;
+				for (size_t j = i + 1; j < N; j++) {
+					const VertexAttribute& b = attributes[j];
+					if (a.offset < b.offset + b.bytes() && b.offset < a.offset + a.bytes()) return false;
+				}
+			}
+			return true;
+		}
+
+		VertexFormat format(u32 divisor = 0) const {
+			return VertexFormat(stride, attributes.data(), N, divisor);
+		}
+	};
+
+	template <typename Vertex, typename... Attributes>
+	constexpr VertexLayout<Vertex, sizeof...(Attributes)> vertexLayout(Attributes... attributes) {
+		return { { { attributes... } } };
+	}
+}
+
+// vertexAttribute() for `Vertex::member`, optionally read as `Mode`.
+#define GT_VERTEX_ATTRIBUTE(Vertex, member) \
+	::gt::vertexAttribute<decltype(Vertex::member)>(offsetof(Vertex, member))
+#define GT_VERTEX_ATTRIBUTE_AS(Vertex, member, Mode) \
+	::gt::vertexAttribute<decltype(Vertex::member), ::gt::Mode>(offsetof(Vertex, member))
+
+#endif // VERTEX_LAYOUT_H
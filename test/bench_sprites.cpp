@@ -0,0 +1,348 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if __has_include("SDL.h")
+#	include "SDL.h"
+#else
+#	include "SDL2/SDL.h"
+#endif
+
+#include "glad/glad.h"
+#include "graphics/gpu_sprite_layer.h"
+#include "graphics/sprite_batch.h"
+#include "graphics/sprite_mesh.h"
+#include "graphics/vertex_array_cache.h"
+#include "math/math.hpp"
+#include "log.h"
+
+using namespace gt;
+
+// Headless SpriteBatch throughput benchmark. Every scene is drawn for a fixed
+// number of frames from a fixed seed into a hidden window, so runs on the same
+// machine and driver are comparable.
+//
+//   gt_bench_sprites [--layout=quads|packed|instanced] [--persistent] [--out=file.json]
+//
+// The "gpulayer" scene only runs with --layout=instanced.
+
+constexpr u32 Width = 1280;
+constexpr u32 Height = 720;
+constexpr u32 WarmupFrames = 10;
+constexpr u32 Frames = 120;
+constexpr u32 TextureCount = 32;
+constexpr u32 Seed = 0x5EED;
+
+static const u32 Counts[] = { 1000, 10000, 50000, 200000 };
+
+enum Scene {
+	SceneStatic = 0,
+	SceneRotating,
+	SceneTextures,
+	SceneBlending,
+	SceneMeshes,
+	SceneDrawMany,
+	SceneGpuLayer,
+	SceneCount
+};
+
+static const char* SceneNames[] = { "static", "rotating", "textures", "blending", "meshes", "drawmany", "gpulayer" };
+
+// sprites of the gpulayer scene updated per frame, one in this many
+constexpr u32 LayerUpdateStep = 16;
+
+// rand() differs between C libraries, this doesn't
+struct Random {
+	u32 state;
+
+	float next() {
+		state = state * 1664525u + 1013904223u;
+		return float(state >> 8) / float(1 << 24);
+	}
+};
+
+struct Sprite {
+	Vector2 position;
+	float rotation, spin, scale;
+	Vector4 color;
+	u32 texture;
+};
+
+struct Result {
+	Scene scene;
+	u32 sprites;
+	double cpuMs, frameMs;
+	u64 bytes;
+	u32 draws, flushes;
+};
+
+constexpr u32 TextureSize = 64;
+constexpr u32 MeshVertices = 8;
+
+static std::vector<u8> makePixels(u32 index) {
+	constexpr u32 Size = TextureSize;
+	std::vector<u8> pixels(Size * Size * 4);
+	for (u32 y = 0; y < Size; y++) {
+		for (u32 x = 0; x < Size; x++) {
+			const float dx = x + 0.5f - Size * 0.5f, dy = y + 0.5f - Size * 0.5f;
+			u8* p = &pixels[(y * Size + x) * 4];
+			p[0] = u8(index * 37);
+			p[1] = u8(x * 4);
+			p[2] = u8(y * 4);
+			p[3] = dx * dx + dy * dy < Size * Size * 0.25f ? 255 : 0;
+		}
+	}
+	return pixels;
+}
+
+static Texture makeTexture(u32 index) {
+	const std::vector<u8> pixels = makePixels(index);
+
+	Texture tex;
+	tex.create(TextureType::Texture2D, Format::RGBA, TextureSize, TextureSize).bind()
+		.filter(TextureFilter::Linear, TextureFilter::Linear)
+		.wrapMode(TextureWrap::ClampToEdge, TextureWrap::ClampToEdge)
+		.update(pixels.data(), DataType::TypeUByte);
+	return tex;
+}
+
+static std::vector<Sprite> makeSprites(Scene scene, u32 count) {
+	Random rnd{ Seed };
+	std::vector<Sprite> sprites(count);
+	for (Sprite& s : sprites) {
+		s.position = Vector2(rnd.next() * Width, rnd.next() * Height);
+		s.rotation = rnd.next() * Tau;
+		s.spin = scene == SceneRotating ? (rnd.next() - 0.5f) * 4.0f : 0.0f;
+		s.scale = 0.25f + rnd.next() * 0.5f;
+		s.color = Vector4(rnd.next(), rnd.next(), rnd.next(), 0.5f + rnd.next() * 0.5f);
+		s.texture = scene == SceneTextures || scene == SceneGpuLayer ? u32(rnd.next() * TextureCount) : 0;
+	}
+	return sprites;
+}
+
+// Every texture is the same disc, so one outline fits all of them.
+static SpriteMesh disc;
+
+// The static scene as structure-of-arrays, drawn with a single drawMany() to
+// compare against the per-sprite draw() calls of "static".
+struct SpriteColumns {
+	std::vector<Vector2> positions, origins, scales;
+	std::vector<float> rotations;
+	std::vector<Vector4> colors;
+
+	SpriteBatch::SpriteArrays arrays() const {
+		SpriteBatch::SpriteArrays a;
+		a.count = positions.size();
+		a.positions = positions.data();
+		a.rotations = rotations.data();
+		a.origins = origins.data();
+		a.scales = scales.data();
+		a.colors = colors.data();
+		return a;
+	}
+};
+
+static SpriteColumns makeColumns(const std::vector<Sprite>& sprites) {
+	SpriteColumns cols;
+	for (const Sprite& s : sprites) {
+		cols.positions.push_back(s.position);
+		cols.rotations.push_back(s.rotation);
+		cols.origins.push_back(Vector2(0.5f));
+		cols.scales.push_back(Vector2(s.scale));
+		cols.colors.push_back(s.color);
+	}
+	return cols;
+}
+
+static void drawFrame(
+	SpriteBatch& sb, Scene scene, std::vector<Sprite>& sprites, const SpriteColumns& columns,
+	GpuSpriteLayer* layer, std::vector<Texture>& textures, float dt
+) {
+	sb.begin();
+	sb.enableBlending();
+	sb.blendFunction(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (layer) {
+		// a few sprites move every frame, the rest stay on the GPU untouched
+		for (u32 i = 0; i < sprites.size(); i += LayerUpdateStep) {
+			Sprite& s = sprites[i];
+			s.rotation += dt;
+			layer->update(i, s.position, s.rotation, Vector2(0.5f), Vector2(s.scale));
+		}
+		sb.draw(*layer);
+		sb.end();
+		return;
+	}
+	if (scene == SceneDrawMany) {
+		sb.drawMany(textures[0], columns.arrays());
+		sb.end();
+		return;
+	}
+	for (u32 i = 0; i < sprites.size(); i++) {
+		Sprite& s = sprites[i];
+		s.rotation += s.spin * dt;
+
+		// switch between alpha and additive blending every 64 sprites
+		if (scene == SceneBlending && i % 64 == 0) {
+			if ((i / 64) % 2) sb.blendFunction(GL_ONE, GL_ONE);
+			else sb.blendFunction(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		}
+
+		sb.color(s.color);
+		if (scene == SceneMeshes) {
+			sb.draw(textures[s.texture], disc, s.position, s.rotation, Vector2(0.5f), Vector2(s.scale));
+		} else {
+			sb.draw(textures[s.texture], s.position, s.rotation, Vector2(0.5f), Vector2(s.scale));
+		}
+	}
+	sb.end();
+}
+
+static Result run(SpriteBatch& sb, Scene scene, u32 count, std::vector<Texture>& textures) {
+	using Clock = std::chrono::high_resolution_clock;
+
+	std::vector<Sprite> sprites = makeSprites(scene, count);
+	const SpriteColumns columns = makeColumns(sprites);
+
+	std::unique_ptr<GpuSpriteLayer> layer;
+	if (scene == SceneGpuLayer) {
+		layer = std::make_unique<GpuSpriteLayer>(sb, count);
+		for (const Sprite& s : sprites) {
+			layer->color(s.color);
+			layer->add(textures[s.texture], s.position, s.rotation, Vector2(0.5f), Vector2(s.scale));
+		}
+	}
+	const float dt = 1.0f / 60.0f;
+
+	for (u32 i = 0; i < WarmupFrames; i++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		drawFrame(sb, scene, sprites, columns, layer.get(), textures, dt);
+	}
+	glFinish();
+
+	Result res{ scene, count, 0.0, 0.0, 0, 0, 0 };
+	for (u32 i = 0; i < Frames; i++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		const auto start = Clock::now();
+		drawFrame(sb, scene, sprites, columns, layer.get(), textures, dt);
+		const auto submitted = Clock::now();
+		glFinish();
+		const auto finished = Clock::now();
+
+		res.cpuMs += std::chrono::duration<double, std::milli>(submitted - start).count();
+		res.frameMs += std::chrono::duration<double, std::milli>(finished - start).count();
+
+		const SpriteBatch::Stats& stats = sb.stats();
+		res.bytes += stats.bytes;
+		res.draws += stats.draws;
+		res.flushes += stats.flushes;
+	}
+	return res;
+}
+
+static std::string toJson(const std::vector<Result>& results, const std::string& layout, bool persistent, const char* renderer) {
+	std::ostringstream out;
+	out << "{\n";
+	out << "  \"renderer\": \"" << renderer << "\",\n";
+	out << "  \"layout\": \"" << layout << "\",\n";
+	out << "  \"stream\": \"" << (persistent ? "persistent" : "buffered") << "\",\n";
+	out << "  \"seed\": " << Seed << ",\n";
+	out << "  \"frames\": " << Frames << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		const double cpuMs = r.cpuMs / Frames;
+		out << "    { "
+			<< "\"scene\": \"" << SceneNames[r.scene] << "\", "
+			<< "\"sprites\": " << r.sprites << ", "
+			<< "\"cpuMsPerFrame\": " << cpuMs << ", "
+			<< "\"frameMsPerFrame\": " << r.frameMs / Frames << ", "
+			<< "\"spritesPerSecond\": " << (cpuMs > 0.0 ? r.sprites * 1000.0 / cpuMs : 0.0) << ", "
+			<< "\"bytesPerFrame\": " << r.bytes / Frames << ", "
+			<< "\"drawCallsPerFrame\": " << double(r.draws) / Frames << ", "
+			<< "\"flushesPerFrame\": " << double(r.flushes) / Frames
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+	return out.str();
+}
+
+int main(int argc, char** argv) {
+	std::string layoutName = "quads", outPath = "bench_sprites.json";
+	bool persistent = false;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (arg.rfind("--layout=", 0) == 0) layoutName = arg.substr(9);
+		else if (arg == "--persistent") persistent = true;
+		else if (arg.rfind("--out=", 0) == 0) outPath = arg.substr(6);
+	}
+
+	SpriteBatch::Layout layout = SpriteBatch::LayoutQuads;
+	if (layoutName == "packed") layout = SpriteBatch::LayoutPackedQuads;
+	else if (layoutName == "instanced") layout = SpriteBatch::LayoutInstanced;
+	else layoutName = "quads";
+
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+		LogE(SDL_GetError());
+		return 1;
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+	SDL_Window* window = SDL_CreateWindow(
+		"gt_bench_sprites",
+		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		Width, Height,
+		SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL
+	);
+	SDL_GLContext context = window ? SDL_GL_CreateContext(window) : nullptr;
+	if (!context || !gladLoadGL()) {
+		LogE("Failed to create an OpenGL 4.3 context: ", SDL_GetError());
+		if (window) SDL_DestroyWindow(window);
+		SDL_Quit();
+		return 1;
+	}
+	SDL_GL_SetSwapInterval(0);
+	glViewport(0, 0, Width, Height);
+
+	std::vector<Result> results;
+	{
+		std::vector<Texture> textures;
+		for (u32 i = 0; i < TextureCount; i++) textures.push_back(makeTexture(i));
+		disc = SpriteMesh::fromAlpha(makePixels(0).data(), TextureSize, TextureSize, Vector4(0, 0, 1, 1), MeshVertices);
+
+		SpriteBatch sb(
+			Width, Height,
+			persistent ? SpriteBatch::StreamPersistent : SpriteBatch::StreamBuffered,
+			layout
+		);
+
+		for (u32 scene = 0; scene < SceneCount; scene++) {
+			if (scene == SceneGpuLayer && layout != SpriteBatch::LayoutInstanced) continue;
+			for (u32 count : Counts) {
+				results.push_back(run(sb, Scene(scene), count, textures));
+			}
+		}
+
+		for (Texture& tex : textures) tex.destroy();
+	}
+
+	const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+	const std::string json = toJson(results, layoutName, persistent, renderer ? renderer : "unknown");
+	std::ofstream(outPath) << json;
+	LogI("Wrote ", results.size(), " results to ", outPath);
+
+	// the cached vertex arrays belong to the context
+	VertexArrayCache::get().clear();
+	SDL_GL_DeleteContext(context);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return 0;
+}
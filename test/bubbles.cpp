@@ -5,6 +5,8 @@
 
 #include "game_window.h"
 #include "graphics/sprite_batch.h"
+#include "graphics/sprite_mesh.h"
+#include "log.h"
 #include "math/math.hpp"
 
 using namespace gt;
@@ -52,11 +54,17 @@ struct Object {
 
 constexpr float circleScale = 0.2f;
 constexpr float massFactor = 0.02f;
+constexpr u32 maxObjects = 200000;
+constexpr u32 frameCount = 15;
 
 class Game : public GameAdapter {
 public:
 	void create(GameWindow& gw) {
-		sb = std::unique_ptr<SpriteBatch>(new SpriteBatch(gw.width(), gw.height()));
+		sb = std::unique_ptr<SpriteBatch>(new SpriteBatch(
+			gw.width(), gw.height(),
+			SpriteBatch::StreamPersistent, SpriteBatch::LayoutQuads,
+			8192, SpriteBatch::GrowGeometric, maxObjects
+		));
 
 		i32 w, h, comp;
 		u8* data = stbi_load("ball.png", &w, &h, &comp, 4);
@@ -66,13 +74,18 @@ public:
 				.wrapMode(TextureWrap::Repeat, TextureWrap::Repeat)
 				.update(data, DataType::TypeUByte)
 				.generateMipmaps();
+
+			const float tw = 1.0f / frameCount;
+			for (const SpriteMesh::Fit& fit : SpriteMesh::survey(data, w, h, Vector4(0.0f, 0.0f, tw, 1.0f))) {
+				LogI("ball.png: ", fit.vertices, " vertices cover ", fit.area * 100.0f, "% of the frame");
+			}
 			stbi_image_free(data);
 		}
 
 		objects.reserve(20000);
 
 		normals.create().bind()
-			.add(SBVertexShader, Shader::VertexShader)
+			.add(sb->vertexShaderSource(), Shader::VertexShader)
 			.add(FS, Shader::FragmentShader)
 			.link();
 		sb->shader(normals);
@@ -88,18 +101,36 @@ public:
 		glClearColor(0.0f, 0.05f, 0.2f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		const float tw = 1.0f / 15;
+		const float tw = 1.0f / frameCount;
 
-		sb->begin();
-		sb->enableBlending();
-		sb->blendFunction(GL_ONE, GL_ONE);
+		positions.clear();
+		origins.clear();
+		scales.clear();
+		uvs.clear();
+		colors.clear();
 		for (auto&& g : objects) {
 			float d = g.dim;
-			float tx = (g.frame % 15) * tw;
+			float tx = (g.frame % frameCount) * tw;
 
-			sb->color(Vector4(g.color.x * d, g.color.y * d, g.color.z * d, 1.0f));
-			sb->draw(tex, g.pos, 0.0f, Vector2(0.5f), Vector2(circleScale * g.size), Vector4(tx, 0.0f, tw, 1.0f));
+			positions.push_back(g.pos);
+			origins.push_back(Vector2(0.5f));
+			scales.push_back(Vector2(circleScale * g.size));
+			uvs.push_back(Vector4(tx, 0.0f, tw, 1.0f));
+			colors.push_back(Vector4(g.color.x * d, g.color.y * d, g.color.z * d, 1.0f));
 		}
+
+		SpriteBatch::SpriteArrays sprites;
+		sprites.count = positions.size();
+		sprites.positions = positions.data();
+		sprites.origins = origins.data();
+		sprites.scales = scales.data();
+		sprites.uvs = uvs.data();
+		sprites.colors = colors.data();
+
+		sb->begin();
+		sb->enableBlending();
+		sb->blendFunction(GL_ONE, GL_ONE);
+		sb->drawMany(tex, sprites);
 		sb->end();
 	}
 
@@ -111,7 +142,7 @@ public:
 			std::to_string(objects.size()) + " objects"
 		);
 
-		if (gw.mouseHeld(1) && objects.size() < SpritesCount) {
+		if (gw.mouseHeld(1) && objects.size() < maxObjects) {
 			for (u32 i = 0; i < 10; i++) {
 				Object g{};
 				float a = rnd() * Tau;
@@ -237,6 +268,8 @@ public:
 	}
 
 	std::vector<Object> objects;
+	std::vector<Vector2> positions, origins, scales;
+	std::vector<Vector4> uvs, colors;
 	std::unique_ptr<SpriteBatch> sb;
 	Texture tex;
 	Shader normals;
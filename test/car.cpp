@@ -73,7 +73,7 @@ public:
 		}
 
 		carShader.create().bind()
-			.add(SBVertexShader, Shader::VertexShader)
+			.add(sb->vertexShaderSource(), Shader::VertexShader)
 			.add(FS, Shader::FragmentShader)
 			.link();
 		sb->shader(carShader);
@@ -102,7 +102,7 @@ public:
 		sb->end();
 
 		sb->resetShader();
-		sb->begin();
+		sb->begin(SpriteBatch::SortDeferred);
 		sb->enableBlending();
 		sb->blendFunction(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 